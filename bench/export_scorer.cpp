@@ -0,0 +1,78 @@
+/**
+ * \file export_scorer.cpp
+ * \author Kefei Lu
+ * \brief Train a model and export it as a C++ scoring header.
+ *
+ * Trains a NaiveBayesClassifier on an arff file, on the given attributes
+ * or all of them, and saves it with CompiledModel::save_header(). With
+ * -d, the numeric attributes are discretized
+ * (NaiveBayesClassifierDiscrete). Checks that the compiled model agrees
+ * with classify_inst() and log_likelihood() on every instance, and exits
+ * with 1 if not.
+ *
+ * Usage: export_scorer [-d] file.arff class_index header.h name [att ...]
+ */
+
+#include "../common.h"
+#include "../dataset.h"
+#include "../classifier.h"
+#include "../compiledmodel.h"
+
+/** |a - b| of two log likelihoods: 0 if both are NaN, HUGE_VAL if only
+ * one is. */
+static double
+log_difference(const double a, const double b)
+{
+    if (a == b || (a != a && b != b)) return 0;
+    if (a != a || b != b) return HUGE_VAL;
+    return fabs(a - b);
+}
+
+int main(int argc, char** argv)
+{
+    bool discrete = 0;
+    if (argc > 1 && strcmp(argv[1], "-d") == 0) {
+	discrete = 1;
+	argc --;
+	argv ++;
+    }
+    if (argc < 5) {
+	fprintf(stderr, "Usage: export_scorer [-d] file.arff class_index "
+		"header.h name [att ...]\n");
+	return 1;
+    }
+    Dataset ds(argv[1]);
+    const size_t classIndex = atoi(argv[2]);
+    NaiveBayesClassifier* c = discrete ?
+	new NaiveBayesClassifierDiscrete(ds, classIndex) :
+	new NaiveBayesClassifier(ds, classIndex);
+    if (argc > 5) {
+	for (int i=5;i<argc;i++) {
+	    c->only_these_att().push_back(atoi(argv[i]));
+	}
+	c->useAllAtt() = 0;
+    }
+    c->train();
+    const CompiledModel model(*c);
+    model.save_header(argv[3], argv[4]);
+    fprintf(stdout, "(I) Saved the scorer of %d attributes to %s.\n",
+	    (int)model.num_of_att(), argv[3]);
+
+    size_t nDiff = 0;
+    double maxDiff = 0;
+    for (size_t i=0;i<ds.num_of_inst();i++) {
+	if (model.classify(ds[i]) != c->classify_inst(ds[i])) nDiff ++;
+	for (size_t j=0;j<model.num_of_class();j++) {
+	    maxDiff = max(maxDiff, log_difference(model.log_likelihood(j, ds[i]),
+			c->log_likelihood(j, ds[i])));
+	}
+    }
+    delete c;
+    if (nDiff || maxDiff != 0) {
+	fprintf(stderr, "(E) The compiled model disagrees with the classifier: "
+		"%d predictions differ, max |log likelihood difference| %g.\n",
+		(int)nDiff, maxDiff);
+	return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,106 @@
+/**
+ * \file gauss_bench.cpp
+ * \author Kefei Lu
+ * \brief Benchmark of the batch Gaussian kernel of CompiledModel.
+ *
+ * Trains a NaiveBayesClassifier on an arff file, then scores every 
+ * instance on every class with:
+ *   - NormalDistribution::prob() on each (class, numeric attribute), 
+ *     the way the model was scored before the log space scoring;
+ *   - CompiledModel::score_batch() with each supported instruction set.
+ * Checks that the batch predictions are those of classify_inst(), and 
+ * prints the throughput in Gaussian terms per second.
+ *
+ * Usage: gauss_bench [file.arff [class_index [repeat]]]
+ * The class index defaults to the last attribute.
+ */
+
+#include "../common.h"
+#include "../dataset.h"
+#include "../classifier.h"
+#include "../compiledmodel.h"
+#include <sys/time.h>
+
+static double
+now()
+{
+    timeval t;
+    gettimeofday(&t, NULL);
+    return t.tv_sec + t.tv_usec * 1e-6;
+}
+
+int main(int argc, char** argv)
+{
+    const char* file = argc > 1 ? argv[1] : "test.arff";
+    Dataset ds(file);
+    const size_t classIndex = argc > 2 ? atoi(argv[2]) : ds.num_of_att()-1;
+    const size_t repeat = argc > 3 ? atoi(argv[3]) : 10;
+
+    NaiveBayesClassifier c(ds, classIndex);
+    c.train();
+    const size_t nInst = ds.num_of_inst();
+    const size_t nClass = c.pClass().size();
+    vector<size_t> rows(nInst);
+    for (size_t i=0;i<nInst;i++) rows[i] = i;
+
+    vector<size_t> numeric;
+    for (size_t a=0;a<ds.num_of_att();a++) {
+	if (a == classIndex) continue;
+	if (ds.get_att_desc(a).get_type() == ATT_TYPE_NUMERIC) numeric.push_back(a);
+    }
+    const double nTerm = (double)nInst * nClass * numeric.size() * repeat;
+
+    // The scalar path.
+    const vector< vector<Distribution*> >& table = c.attDistrOnClass().table();
+    double sink = 0;
+    double t0 = now();
+    for (size_t r=0;r<repeat;r++) {
+	for (size_t i=0;i<nInst;i++) {
+	    for (size_t j=0;j<nClass;j++) {
+		double p = 1;
+		for (size_t k=0;k<numeric.size();k++) {
+		    const Attribute att = ds[i][numeric[k]];
+		    if (att.unknown) continue;
+		    p *= table[j][numeric[k]]->prob(att.value);
+		}
+		sink += p;
+	    }
+	}
+    }
+    double t = now() - t0;
+    fprintf(stdout, "(I) %-28s %8.2f Mterm/s\n", "NormalDistribution::prob", 
+	    nTerm / t / 1e6);
+
+    // The predictions to check against.
+    vector<NominalType> expect(nInst);
+    for (size_t i=0;i<nInst;i++) {
+	expect[i] = c.classify_inst(ds[i]);
+    }
+
+    const CompiledModel model(c);
+    vector<double> logL(nInst * nClass);
+    vector<NominalType> label(nInst);
+    int ret = 0;
+    for (int l=CompiledModel::SIMD_SCALAR;l<=CompiledModel::SIMD_AVX2;l++) {
+	CompiledModel::SimdLevel level = (CompiledModel::SimdLevel)l;
+	if (CompiledModel::set_simd_level(level) != level) continue;
+	t0 = now();
+	for (size_t r=0;r<repeat;r++) {
+	    model.score_batch(ds, &rows[0], nInst, &logL[0]);
+	    sink += logL[0];
+	}
+	t = now() - t0;
+	model.classify_batch(ds, &rows[0], nInst, &label[0]);
+	size_t nDiff = 0;
+	for (size_t i=0;i<nInst;i++) {
+	    if (label[i] != expect[i]) nDiff ++;
+	}
+	if (nDiff) ret = 1;
+	fprintf(stdout, "(I) score_batch %-14s %8.2f Mterm/s, "
+		"%lu prediction(s) differ\n", 
+		CompiledModel::simd_name(level), nTerm / t / 1e6, 
+		(unsigned long)nDiff);
+    }
+    if (sink == 1) fprintf(stdout, " ");
+    return ret;
+}
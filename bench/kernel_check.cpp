@@ -0,0 +1,154 @@
+/**
+ * \file kernel_check.cpp
+ * \author Kefei Lu
+ * \brief Check of KernelDistribution against a direct kernel sum.
+ *
+ * Fits heavy-tailed columns: values in [0, 1) with one at 10^6, and
+ *   log-normal ones, with each bandwidth rule and grid sizes down to the
+ *   smallest. Checks that bandwidth() is the one of the rule, computed
+ *   here from its definition, and not widened to the range of the values.
+ *   Compares log_prob() with the log of the sum of the Gaussian kernels
+ *   of that bandwidth at every value, floored at one kernel at the cut
+ *   off as KernelDistribution is, within NEAR bandwidths of a value:
+ *   evenly over the values, and around a sample of them and the largest
+ *   ones. On a grid of a quarter of the bandwidth, the linear binning is
+ *   off by a few hundredths in log density near a value, and by up to
+ *   about two tenths NEAR bandwidths from a lone one; more than
+ *   TOLERANCE is an error. Prints the largest difference of each, and
+ *   exits with 1 if one is more or a bandwidth differs.
+ *
+ * Usage: kernel_check
+ */
+
+#include "../common.h"
+#include "../classifier.h"
+
+static const double TOLERANCE = 0.25;
+static const double NEAR = 4;
+
+/** The bandwidth of rule for the sorted values, as documented. */
+static double
+rule_bandwidth(const vector<double>& sorted, const KernelDistribution::Bandwidth rule)
+{
+    const size_t n = sorted.size();
+    if (rule == KernelDistribution::BANDWIDTH_JOHN_LANGLEY) {
+	return (sorted[n-1] - sorted[0]) / sqrt((double)n);
+    }
+    double mean = 0, ss = 0;
+    for (size_t i=0;i<n;i++) mean += sorted[i];
+    mean /= n;
+    for (size_t i=0;i<n;i++) ss += (sorted[i] - mean) * (sorted[i] - mean);
+    const double sd = sqrt(ss / (n-1));
+    if (rule == KernelDistribution::BANDWIDTH_SCOTT) {
+	return 1.06 * sd * pow((double)n, -0.2);
+    }
+    const double iqr = sorted[(3*n)/4] - sorted[n/4];
+    return 0.9 * (iqr > 0 ? min(sd, iqr/1.34) : sd) * pow((double)n, -0.2);
+}
+
+/** log of the kernel sum at x, floored at the kernel at the cut off. */
+static double
+direct_log_density(const vector<double>& values, const double h,
+	const double x)
+{
+    const size_t n = values.size();
+    const double cutoff = KernelDistribution::CUTOFF;
+    const double logPeak = -log(n * h * sqrt(2*M_PI));
+    double sum = 0;
+    for (size_t i=0;i<n;i++) {
+	const double d = (x - values[i]) / h;
+	sum += exp(-0.5*d*d);
+    }
+    return logPeak + log(max(sum, exp(-0.5*cutoff*cutoff)));
+}
+
+/** The distance from x to the nearest of the sorted values. */
+static double
+distance(const vector<double>& sorted, const double x)
+{
+    const size_t i = lower_bound(sorted.begin(), sorted.end(), x) - sorted.begin();
+    double d = HUGE_VAL;
+    if (i < sorted.size()) d = sorted[i] - x;
+    if (i > 0) d = min(d, x - sorted[i-1]);
+    return d;
+}
+
+/**
+ * The largest difference of log_prob() evenly over the values and
+ *   around them, or HUGE_VAL if the bandwidth is not the rule's.
+ */
+static double
+check(const char* name, vector<double> values,
+	const KernelDistribution::Bandwidth rule, const size_t gridSize)
+{
+    KernelDistribution k;
+    k.fit(values, rule, gridSize);
+    const double h = rule_bandwidth(values, rule);
+    if (!(fabs(k.bandwidth() - h) <= 1e-9 * h)) {
+	fprintf(stdout, "(I) %-10s rule %d grid %4d: bandwidth %g, not the "
+		"rule's %g\n", name, (int)rule, (int)gridSize, k.bandwidth(), h);
+	return HUGE_VAL;
+    }
+    const double cutoff = KernelDistribution::CUTOFF;
+    const double lo = values.front() - cutoff*h;
+    const double hi = values.back() + cutoff*h;
+    vector<double> x;
+    for (size_t i=0;i<=4000;i++) x.push_back(lo + (hi - lo) * i / 4000);
+    // Around a sample of the values and the largest ones, at steps not
+    // on the grid.
+    const size_t n = values.size();
+    for (size_t i=0;i<n;i+=(i+20<n ? max(n/200, (size_t)1) : 1)) {
+	for (int t=-(int)(cutoff+1)*4;t<=(int)(cutoff+1)*4;t++) {
+	    x.push_back(values[i] + t*h*0.2497);
+	}
+    }
+    double worst = 0, at = 0;
+    for (size_t i=0;i<x.size();i++) {
+	if (distance(values, x[i]) > NEAR*h) continue;
+	ValueType v;
+	v.num = x[i];
+	const double d = fabs(k.log_prob(v) - direct_log_density(values, h, x[i]));
+	if (!(d <= worst)) {
+	    worst = d;
+	    at = x[i];
+	}
+    }
+    fprintf(stdout, "(I) %-10s rule %d grid %4d: %4d clusters, %5d points, "
+	    "h %-10.4g max |log difference| %.4f at %g\n", name, (int)rule,
+	    (int)gridSize, (int)k.num_of_cluster(), (int)k.grid_size(), h,
+	    worst, at);
+    return worst;
+}
+
+int main()
+{
+    srand(1);
+    vector<double> outlier;
+    for (size_t i=0;i<1000;i++) outlier.push_back(rand() / (RAND_MAX + 1.0));
+    outlier.push_back(1e6);
+    // Log-normal, as flow sizes and durations.
+    vector<double> lognormal;
+    for (size_t i=0;i<5000;i++) {
+	const double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+	const double z = sqrt(-2*log(u)) * cos(2*M_PI * rand() / (RAND_MAX + 1.0));
+	lognormal.push_back(exp(2*z));
+    }
+
+    const size_t grids[] = {512, 64, 2};
+    double worst = 0;
+    for (int r=0;r<=KernelDistribution::BANDWIDTH_JOHN_LANGLEY;r++) {
+	const KernelDistribution::Bandwidth rule = (KernelDistribution::Bandwidth)r;
+	for (size_t g=0;g<sizeof(grids)/sizeof(grids[0]);g++) {
+	    worst = max(worst, check("outlier", outlier, rule, grids[g]));
+	    worst = max(worst, check("lognormal", lognormal, rule, grids[g]));
+	}
+    }
+    if (!(worst <= TOLERANCE)) {
+	fprintf(stderr, "(E) The kernel density is off by %g in log, more "
+		"than %g.\n", worst, TOLERANCE);
+	return 1;
+    }
+    fprintf(stdout, "(I) The kernel densities are within %g in log.\n",
+	    TOLERANCE);
+    return 0;
+}
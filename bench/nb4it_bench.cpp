@@ -0,0 +1,493 @@
+/**
+ * \file nb4it_bench.cpp
+ * \author Kefei Lu
+ * \brief Benchmark suite of loading, training, testing and cross
+ *   validation.
+ *
+ * Runs on synthetic datasets, made the same from a fixed seed on every
+ *   run: numeric attributes drawn from a normal distribution of a mean
+ *   per class, one in ten nominal ones of 4 values leaning to one per
+ *   class, and the class last. Measures:
+ *   - read_arff: Dataset::read_arff() of a saved dataset, with one and
+ *     all threads, in MB/s; and open_binary() of its binary file;
+ *   - train: NaiveBayesClassifier::train() as the rows, the attributes
+ *     and the classes vary, one at a time from a base dataset;
+ *   - classify_inst: the time per instance of classify_inst(), and of
+ *     CompiledModel::classify_batch();
+ *   - xvalidate: Xvalidator::xvalidate() of 8 folds, end to end.
+ *   The same are run on file.arff if given.
+ *
+ * Each benchmark is run repeat times; the minimum and the median times
+ *   are reported, the rate from the minimum. The results are written as
+ *   JSON to out.json, or stdout, to be compared between commits; tag
+ *   names the run, e.g. the commit. The output of the library goes to
+ *   /dev/null, a summary of each result to stderr.
+ *
+ * Usage: nb4it_bench [-o out.json] [-r repeat] [-t tag]
+ *   [file.arff [class_index]]
+ * The class index defaults to the last attribute.
+ */
+
+#include "../common.h"
+#include "../dataset.h"
+#include "../classifier.h"
+#include "../compiledmodel.h"
+#include "../xvalidator.h"
+#include "../parallel.h"
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+static double
+now()
+{
+    timeval t;
+    gettimeofday(&t, NULL);
+    return t.tv_sec + t.tv_usec * 1e-6;
+}
+
+/** xorshift64*, so the datasets do not depend on the rand() of libc. */
+struct Rng {
+    uint64_t	s;
+    Rng(const uint64_t seed) : s(seed * 0x9e3779b97f4a7c15ULL + 1) {}
+    uint64_t next() {
+	s ^= s >> 12;
+	s ^= s << 25;
+	s ^= s >> 27;
+	return s * 0x2545f4914f6cdd1dULL;
+    }
+    /** In [0, 1). */
+    double uniform() {return (next() >> 11) * (1.0 / 9007199254740992.0);}
+    /** Box-Muller. */
+    double normal() {
+	const double u = 1 - uniform();
+	return sqrt(-2 * log(u)) * cos(2 * M_PI * uniform());
+    }
+};
+
+static const size_t N_VALUE = 4;
+
+/** A dataset of nRow rows, nAtt attributes and nClass classes. */
+static void
+make_dataset(Dataset& ds, const size_t nRow, const size_t nAtt,
+	const size_t nClass, const uint64_t seed)
+{
+    Rng rng(seed);
+    char name[32];
+    vector<bool> nominal(nAtt);
+    // The mean of each numeric attribute in each class, in [-2, 2].
+    vector< vector<double> > mean(nClass, vector<double>(nAtt));
+    for (size_t j=0;j<nAtt;j++) {
+	nominal[j] = j % 10 == 9;
+	snprintf(name, sizeof(name), "a%lu", (unsigned long)j);
+	AttDesc desc(name, nominal[j] ? ATT_TYPE_NOMINAL : ATT_TYPE_NUMERIC);
+	for (size_t v=0;nominal[j] && v<N_VALUE;v++) {
+	    snprintf(name, sizeof(name), "v%lu", (unsigned long)v);
+	    desc.possible_value_vector().push_back(name);
+	}
+	ds.add_att(desc);
+	for (size_t c=0;c<nClass;c++) mean[c][j] = 4 * rng.uniform() - 2;
+    }
+    AttDesc klass("class", ATT_TYPE_NOMINAL);
+    for (size_t c=0;c<nClass;c++) {
+	snprintf(name, sizeof(name), "c%lu", (unsigned long)c);
+	klass.possible_value_vector().push_back(name);
+    }
+    ds.add_att(klass);
+
+    Instance inst(nAtt + 1);
+    for (size_t i=0;i<nRow;i++) {
+	const size_t c = rng.next() % nClass;
+	for (size_t j=0;j<nAtt;j++) {
+	    inst[j].unknown = 0;
+	    if (nominal[j]) {
+		inst[j].value.nom = rng.uniform() < 0.5 ? (c + j) % N_VALUE
+		    : rng.next() % N_VALUE;
+	    } else {
+		inst[j].value.num = mean[c][j] + rng.normal();
+	    }
+	}
+	inst[nAtt].unknown = 0;
+	inst[nAtt].value.nom = c;
+	ds.push_back(inst);
+    }
+}
+
+/** The times of a benchmark, its parameters and its rate. */
+struct Result {
+    string		name;
+    vector< pair<string, double> > param;
+    vector<double>	time;
+    string		unit;		///< Of the rate.
+    double		perRun;		///< Units per run, the rate per second.
+    bool		inverse;	///< The rate is seconds per unit.
+    double		scale;		///< Of the inverse rate, e.g. 1e9 for ns.
+
+    Result(const char* n) : perRun(0), inverse(0), scale(1) {name = n;}
+    Result& with(const char* key, const double v) {
+	param.push_back(make_pair(string(key), v));
+	return *this;
+    }
+    /** units of unit per second. */
+    Result& rate(const char* u, const double units) {
+	unit = u;
+	perRun = units;
+	return *this;
+    }
+    /** Seconds per unit, times scale. */
+    Result& per(const char* u, const double units, const double s) {
+	rate(u, units);
+	inverse = 1;
+	scale = s;
+	return *this;
+    }
+    double min_time() const {return *min_element(time.begin(), time.end());}
+    double median_time() const {
+	vector<double> t = time;
+	sort(t.begin(), t.end());
+	const size_t n = t.size();
+	return n % 2 ? t[n/2] : (t[n/2-1] + t[n/2]) / 2;
+    }
+    double value() const {
+	const double t = min_time();
+	if (inverse) return perRun > 0 ? t / perRun * scale : 0;
+	return t > 0 ? perRun / t : 0;
+    }
+};
+
+/** Run the benchmarks, collecting their results. */
+class Suite {
+    private:
+	size_t		_repeat;
+	vector<Result>	_result;
+    public:
+	Suite(const size_t repeat) : _repeat(repeat) {}
+	const vector<Result>& results() const {return _result;}
+
+	/** Time f() repeat times, after a run to warm up. */
+	template <class F>
+	Result& run(Result r, F& f) {
+	    f();
+	    for (size_t i=0;i<_repeat;i++) {
+		const double t0 = now();
+		f();
+		r.time.push_back(now() - t0);
+	    }
+	    _result.push_back(r);
+	    Result& res = _result.back();
+	    fprintf(stderr, "(I) %-14s", res.name.c_str());
+	    for (size_t i=0;i<res.param.size();i++) {
+		fprintf(stderr, " %s=%g", res.param[i].first.c_str(),
+			res.param[i].second);
+	    }
+	    fprintf(stderr, ": %.6f s (median %.6f s), %.6g %s\n",
+		    res.min_time(), res.median_time(), res.value(),
+		    res.unit.c_str());
+	    return res;
+	}
+};
+
+struct ReadArff {
+    const char*	file;
+    size_t	nThread;
+    void operator()() {Dataset ds(file, nThread);}
+};
+
+struct OpenBinary {
+    const char*	file;
+    void operator()() {Dataset ds; ds.open_binary(file);}
+};
+
+struct Train {
+    NaiveBayesClassifier* c;
+    void operator()() {c->train();}
+};
+
+struct ClassifyInst {
+    const NaiveBayesClassifier* c;
+    size_t	sum;	///< Of the labels, that the calls are not left out.
+    void operator()() {
+	const Dataset& ds = c->dataset();
+	const size_t nRow = ds.num_of_inst();
+	for (size_t i=0;i<nRow;i++) sum += c->classify_inst(InstanceRef(ds, i));
+    }
+};
+
+struct ClassifyBatch {
+    const CompiledModel* model;
+    const Dataset* ds;
+    const vector<size_t>* rows;
+    vector<NominalType> label;
+    CompiledModel::Scratch scratch;
+    void operator()() {
+	label.resize(rows->size());
+	model->classify_batch(*ds, &(*rows)[0], rows->size(), &label[0],
+		scratch);
+    }
+};
+
+struct Xvalidate {
+    NaiveBayesClassifier* c;
+    size_t	nThread;
+    bool	mergeFolds;
+    void operator()() {
+	Xvalidator x(c, 8, 1);
+	x.n_thread() = nThread;
+	x.merge_folds() = mergeFolds;
+	x.xvalidate();
+    }
+};
+
+static off_t
+file_size(const char* file)
+{
+    struct stat st;
+    return stat(file, &st) == 0 ? st.st_size : 0;
+}
+
+/** The benchmarks of loading a dataset saved as arff. */
+static void
+bench_load(Suite& suite, const char* name, const char* arff, const char* bin,
+	const Dataset& ds)
+{
+    const double mb = file_size(arff) / 1e6;
+    const size_t nCpu = num_of_cpu();
+    ReadArff r = {arff, 1};
+    suite.run(Result(name).with("rows", ds.num_of_inst())
+	    .with("atts", ds.num_of_att() - 1).with("threads", 1)
+	    .with("mb", mb).rate("MB/s", mb), r);
+    if (nCpu > 1) {
+	r.nThread = 0;
+	suite.run(Result(name).with("rows", ds.num_of_inst())
+		.with("atts", ds.num_of_att() - 1).with("threads", nCpu)
+		.with("mb", mb).rate("MB/s", mb), r);
+    }
+    if (!bin) return;
+    OpenBinary o = {bin};
+    suite.run(Result("open_binary").with("rows", ds.num_of_inst())
+	    .with("atts", ds.num_of_att() - 1).with("mb", file_size(bin) / 1e6)
+	    .rate("MB/s", file_size(bin) / 1e6), o);
+}
+
+/** Train on all of ds, so that the rows per second are comparable. */
+static void
+bench_train(Suite& suite, const Dataset& ds, const size_t classIndex,
+	const size_t nAtt, const size_t nClass)
+{
+    NaiveBayesClassifier c(ds, classIndex);
+    Train t = {&c};
+    suite.run(Result("train").with("rows", ds.num_of_inst())
+	    .with("atts", nAtt).with("classes", nClass)
+	    .rate("rows/s", ds.num_of_inst()), t);
+}
+
+/** classify_inst(), the batch scoring and xvalidate() on ds. */
+static void
+bench_test(Suite& suite, const Dataset& ds, const size_t classIndex)
+{
+    const size_t nRow = ds.num_of_inst();
+    const size_t nAtt = ds.num_of_att() - 1;
+    const size_t nClass =
+	ds.get_att_desc(classIndex).possible_value_vector().size();
+    NaiveBayesClassifier c(ds, classIndex);
+    c.train();
+    ClassifyInst ci = {&c, 0};
+    suite.run(Result("classify_inst").with("rows", nRow).with("atts", nAtt)
+	    .with("classes", nClass).per("ns/inst", nRow, 1e9), ci);
+
+    const CompiledModel model(c);
+    vector<size_t> rows(nRow);
+    for (size_t i=0;i<nRow;i++) rows[i] = i;
+    ClassifyBatch cb;
+    cb.model = &model;
+    cb.ds = &ds;
+    cb.rows = &rows;
+    suite.run(Result("classify_batch").with("rows", nRow).with("atts", nAtt)
+	    .with("classes", nClass).per("ns/inst", nRow, 1e9), cb);
+
+    Xvalidate x = {&c, 1, 1};
+    suite.run(Result("xvalidate").with("rows", nRow).with("atts", nAtt)
+	    .with("classes", nClass).with("folds", 8).with("threads", 1)
+	    .with("merge_folds", 1).rate("rows/s", nRow), x);
+    x.mergeFolds = 0;
+    suite.run(Result("xvalidate").with("rows", nRow).with("atts", nAtt)
+	    .with("classes", nClass).with("folds", 8).with("threads", 1)
+	    .with("merge_folds", 0).rate("rows/s", nRow), x);
+    if (num_of_cpu() > 1) {
+	x.nThread = 0;
+	x.mergeFolds = 1;
+	suite.run(Result("xvalidate").with("rows", nRow).with("atts", nAtt)
+		.with("classes", nClass).with("folds", 8)
+		.with("threads", num_of_cpu()).with("merge_folds", 1)
+		.rate("rows/s", nRow), x);
+    }
+}
+
+/** Write s as a JSON string. */
+static void
+json_string(FILE* fp, const string& s)
+{
+    fputc('"', fp);
+    for (size_t i=0;i<s.size();i++) {
+	const unsigned char ch = s[i];
+	if (ch == '"' || ch == '\\') fprintf(fp, "\\%c", ch);
+	else if (ch < 0x20) fprintf(fp, "\\u%04x", ch);
+	else fputc(ch, fp);
+    }
+    fputc('"', fp);
+}
+
+static void
+write_json(FILE* fp, const Suite& suite, const char* tag, const size_t repeat,
+	const char* file)
+{
+    char host[256] = "";
+    gethostname(host, sizeof(host) - 1);
+    char date[32];
+    const time_t t = time(NULL);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&t));
+
+    fprintf(fp, "{\n  \"suite\": \"nb4it_bench\",\n  \"tag\": ");
+    json_string(fp, tag);
+    fprintf(fp, ",\n  \"date\": \"%s\",\n  \"host\": ", date);
+    json_string(fp, host);
+    fprintf(fp, ",\n  \"cpus\": %lu,\n  \"simd\": ",
+	    (unsigned long)num_of_cpu());
+    json_string(fp, CompiledModel::simd_name(CompiledModel::simd_level()));
+    fprintf(fp, ",\n  \"repeat\": %lu,\n  \"file\": ", (unsigned long)repeat);
+    if (file) json_string(fp, file);
+    else fprintf(fp, "null");
+    fprintf(fp, ",\n  \"results\": [");
+
+    const vector<Result>& res = suite.results();
+    for (size_t i=0;i<res.size();i++) {
+	const Result& r = res[i];
+	fprintf(fp, "%s\n    {\"name\": ", i ? "," : "");
+	json_string(fp, r.name);
+	for (size_t j=0;j<r.param.size();j++) {
+	    fprintf(fp, ", ");
+	    json_string(fp, r.param[j].first);
+	    fprintf(fp, ": %.10g", r.param[j].second);
+	}
+	fprintf(fp, ",\n     \"min_s\": %.9g, \"median_s\": %.9g, \"times_s\": [",
+		r.min_time(), r.median_time());
+	for (size_t j=0;j<r.time.size();j++) {
+	    fprintf(fp, "%s%.9g", j ? ", " : "", r.time[j]);
+	}
+	fprintf(fp, "],\n     \"value\": %.9g, \"unit\": ", r.value());
+	json_string(fp, r.unit);
+	fprintf(fp, "}");
+    }
+    fprintf(fp, "\n  ]\n}\n");
+}
+
+static int
+usage()
+{
+    fprintf(stderr, "Usage: nb4it_bench [-o out.json] [-r repeat] [-t tag] "
+	    "[file.arff [class_index]]\n");
+    return 1;
+}
+
+int main(int argc, char** argv)
+{
+    const char* output = NULL;
+    const char* tag = "";
+    size_t repeat = 5;
+    int i = 1;
+    for (; i<argc && argv[i][0] == '-' && argv[i][1]; i++) {
+	if (i+1 >= argc) return usage();
+	if (strcmp(argv[i], "-o") == 0) output = argv[++i];
+	else if (strcmp(argv[i], "-r") == 0) repeat = atoi(argv[++i]);
+	else if (strcmp(argv[i], "-t") == 0) tag = argv[++i];
+	else return usage();
+    }
+    if (repeat == 0 || argc - i > 2) return usage();
+    const char* file = i < argc ? argv[i] : NULL;
+
+    // The results to the stdout, if no file; what the library writes
+    // there to /dev/null.
+    fflush(stdout);
+    FILE* out = output ? fopen(output, "w") : fdopen(dup(1), "w");
+    if (!out) {
+	fprintf(stderr, "(E) Opening file %s failed.\n", output);
+	return 1;
+    }
+    const int null = open("/dev/null", O_WRONLY);
+    dup2(null, 1);
+    close(null);
+
+    Suite suite(repeat);
+    const size_t ROWS = 20000, ATTS = 50, CLASSES = 4;
+
+    // Loading, of a dataset of about 35 MB.
+    {
+	char arff[] = "/tmp/nb4it_bench_XXXXXX";
+	const int fd = mkstemp(arff);
+	if (fd < 0) {
+	    fprintf(stderr, "(E) Making a temporary file failed.\n");
+	    return 1;
+	}
+	close(fd);
+	const string bin = string(arff) + ".bin";
+	Dataset ds;
+	make_dataset(ds, 50000, 40, CLASSES, 1);
+	ds.save_arff(arff);
+	ds.save_binary(bin.c_str());
+	bench_load(suite, "read_arff", arff, bin.c_str(), ds);
+	unlink(arff);
+	unlink(bin.c_str());
+    }
+
+    // Training, one of the rows, attributes and classes varying.
+    const size_t rows[] = {5000, 20000, 80000};
+    const size_t atts[] = {10, 50, 200};
+    const size_t classes[] = {2, 4, 16};
+    for (size_t k=0;k<3;k++) {
+	Dataset ds;
+	make_dataset(ds, rows[k], ATTS, CLASSES, 2);
+	bench_train(suite, ds, ATTS, ATTS, CLASSES);
+    }
+    for (size_t k=0;k<3;k++) {
+	if (atts[k] == ATTS) continue;
+	Dataset ds;
+	make_dataset(ds, ROWS, atts[k], CLASSES, 2);
+	bench_train(suite, ds, atts[k], atts[k], CLASSES);
+    }
+    for (size_t k=0;k<3;k++) {
+	if (classes[k] == CLASSES) continue;
+	Dataset ds;
+	make_dataset(ds, ROWS, ATTS, classes[k], 2);
+	bench_train(suite, ds, ATTS, ATTS, classes[k]);
+    }
+
+    // Testing and cross validation, on the base dataset.
+    {
+	Dataset ds;
+	make_dataset(ds, ROWS, ATTS, CLASSES, 3);
+	bench_test(suite, ds, ATTS);
+    }
+
+    if (file) {
+	Dataset ds(file);
+	bench_load(suite, "read_arff_file", file, NULL, ds);
+	const size_t classIndex = i+1 < argc ? atoi(argv[i+1])
+	    : ds.num_of_att() - 1;
+	if (classIndex >= ds.num_of_att() || ds.get_att_desc(classIndex)
+		.get_type() != ATT_TYPE_NOMINAL) {
+	    fprintf(stderr, "(E) The class attribute %lu is not a nominal "
+		    "one.\n", (unsigned long)classIndex);
+	    return 1;
+	}
+	const size_t nClass =
+	    ds.get_att_desc(classIndex).possible_value_vector().size();
+	bench_train(suite, ds, classIndex, ds.num_of_att() - 1, nClass);
+	bench_test(suite, ds, classIndex);
+    }
+
+    write_json(out, suite, tag, repeat, file);
+    fclose(out);
+    return 0;
+}
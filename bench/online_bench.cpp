@@ -0,0 +1,194 @@
+/**
+ * \file online_bench.cpp
+ * \author Kefei Lu
+ * \brief Benchmark of OnlineClassifier.
+ *
+ * Makes a synthetic TSH trace of interleaved flows of two classes, bulk
+ * (port 80, large packets) and interactive (port 22, small ones, more
+ * spread out). Trains a model on the first N packets of the flows of a
+ * training trace (FlowExtractor), then classifies a test trace with
+ * OnlineClassifier, fed from memory 64 KB at a time, the decisions
+ * written to memory. Reports the accuracy, the packets per second and
+ * the decision latency. Exits with 1 if a flow is not decided.
+ *
+ * Usage: online_bench [nFlow [N]]
+ */
+
+#include "../common.h"
+#include "../flow.h"
+#include "../online.h"
+#include <sys/time.h>
+
+static double
+now()
+{
+    timeval t;
+    gettimeofday(&t, NULL);
+    return t.tv_sec + t.tv_usec * 1e-6;
+}
+
+static void
+put16(unsigned char* p, const unsigned v)
+{
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+static void
+put32(unsigned char* p, const uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+struct Record {
+    uint64_t		time;
+    unsigned char	b[TshReader::RECORD];
+    bool operator<(const Record& o) const {return time < o.time;}
+};
+
+static Record
+record(const uint64_t time, const uint32_t src, const uint32_t dst,
+	const unsigned sport, const unsigned dport, const unsigned flags,
+	const unsigned length)
+{
+    Record r;
+    memset(r.b, 0, sizeof(r.b));
+    r.time = time;
+    put32(r.b, time / 1000000);
+    put32(r.b+4, time % 1000000);
+    unsigned char* ip = r.b + 8;
+    ip[0] = 0x45;
+    put16(ip+2, length);
+    ip[8] = 64;
+    ip[9] = IP_PROTO_TCP;
+    put32(ip+12, src);
+    put32(ip+16, dst);
+    unsigned char* tcp = r.b + 28;
+    put16(tcp, sport);
+    put16(tcp+2, dport);
+    tcp[12] = 5 << 4;
+    tcp[13] = flags;
+    put16(tcp+14, 65535);
+    return r;
+}
+
+/** A trace of nFlow flows starting over about nFlow/1000 seconds. */
+static void
+make_trace(const size_t nFlow, const unsigned seed, vector<char>& trace)
+{
+    srand(seed);
+    vector<Record> rec;
+    for (size_t f=0;f<nFlow;f++) {
+	const bool bulk = rand() % 2;
+	const uint32_t client = 0x0a000000 + f;
+	const uint32_t server = 0xc0a80000 + rand() % 256;
+	const unsigned cport = 1024 + f % 60000;
+	const unsigned sport = bulk ? 80 : 22;
+	uint64_t t = 1000000 + f * 1000 + rand() % 1000;
+	rec.push_back(record(t, client, server, cport, sport, TCP_SYN, 60));
+	t += 100 + rand() % 1000;
+	rec.push_back(record(t, server, client, sport, cport, TCP_SYN|TCP_ACK, 60));
+	t += 100 + rand() % 1000;
+	rec.push_back(record(t, client, server, cport, sport, TCP_ACK, 52));
+	const size_t nData = 2 + rand() % 20;
+	for (size_t i=0;i<nData;i++) {
+	    t += bulk ? 200 + rand() % 2000 : 20000 + rand() % 200000;
+	    const bool up = bulk ? i == 0 : rand() % 2;
+	    const unsigned len = bulk ? (up ? 300 : 1000 + rand() % 500)
+		: 60 + rand() % 100;
+	    if (up) {
+		rec.push_back(record(t, client, server, cport, sport,
+			    TCP_ACK|TCP_PSH, len));
+	    } else {
+		rec.push_back(record(t, server, client, sport, cport,
+			    TCP_ACK|TCP_PSH, len));
+	    }
+	}
+	t += 1000;
+	rec.push_back(record(t, client, server, cport, sport, TCP_FIN|TCP_ACK, 52));
+	t += 1000;
+	rec.push_back(record(t, server, client, sport, cport, TCP_FIN|TCP_ACK, 52));
+    }
+    stable_sort(rec.begin(), rec.end());
+    trace.resize(rec.size() * TshReader::RECORD);
+    for (size_t i=0;i<rec.size();i++) {
+	memcpy(&trace[i*TshReader::RECORD], rec[i].b, TshReader::RECORD);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const size_t nFlow = argc > 1 ? atoi(argv[1]) : 100000;
+    const size_t firstN = argc > 2 ? atoi(argv[2]) : 5;
+    const size_t RECORD = TshReader::RECORD;
+
+    // Train on the first N packets of the flows, labeled by port.
+    vector<char> trace;
+    make_trace(nFlow / 10, 1, trace);
+    vector<string> classes;
+    classes.push_back("bulk");
+    classes.push_back("interactive");
+    Dataset train;
+    FlowExtractor::make_schema(train, classes);
+    FlowExtractor ext;
+    ext.first_n() = firstN;
+    TshPacket p;
+    for (size_t i=0;i<trace.size();i+=RECORD) {
+	TshReader::decode((const unsigned char*)&trace[i], p);
+	ext.add(p);
+    }
+    ext.flush(train);
+    const size_t classIndex = Flow::N_FEATURE;
+    const size_t serverPort = 3*FlowDirection::N_FEATURE + 1;
+    Dataset labeled;
+    FlowExtractor::make_schema(labeled, classes);
+    for (size_t i=0;i<train.num_of_inst();i++) {
+	Instance inst(train.num_of_att());
+	for (size_t j=0;j<inst.size();j++) inst[j] = train[i][j];
+	inst[classIndex].unknown = 0;
+	inst[classIndex].value.nom = inst[serverPort].value.num == 80 ? 0 : 1;
+	labeled.push_back(inst);
+    }
+    NaiveBayesClassifier c(labeled, classIndex);
+    c.train();
+    const CompiledModel model(c);
+
+    // Classify the test trace, in lines to count the right ones.
+    make_trace(nFlow, 2, trace);
+    char* line = NULL;
+    size_t lineSize = 0;
+    FILE* out = open_memstream(&line, &lineSize);
+    OnlineClassifier online(model);
+    online.first_n() = firstN;
+    online.output() = out;
+    const size_t CHUNK = 1 << 16;
+    const double t0 = now();
+    for (size_t i=0;i<trace.size();i+=CHUNK) {
+	online.feed(&trace[i], min(CHUNK, trace.size() - i));
+    }
+    online.finish();
+    const double t = now() - t0;
+    online.report(stdout);
+    fclose(out);
+    size_t nRight = 0, nLine = 0;
+    for (char* l=line; l && *l; nLine++) {
+	char* eol = strchr(l, '\n');
+	if (eol) *eol = 0;
+	char client[32], server[32], label[32];
+	sscanf(l, "%*s %31s %31s %31s", client, server, label);
+	const bool http = strstr(server, ":80") != NULL;
+	if (http == (strcmp(label, "bulk") == 0)) nRight ++;
+	l = eol ? eol+1 : NULL;
+    }
+    free(line);
+
+    fprintf(stdout, "%d flows, %d packets (%.1f MB): %d decisions, %.2f%% right\n",
+	    (int)nFlow, (int)(trace.size() / RECORD), trace.size() / 1e6,
+	    (int)nLine, 100.0 * nRight / max(nLine, (size_t)1));
+    fprintf(stdout, "%.0f packets/s, %.1f MB/s\n",
+	    trace.size() / RECORD / t, trace.size() / 1e6 / t);
+    return nLine != nFlow;
+}
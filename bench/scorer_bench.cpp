@@ -0,0 +1,131 @@
+/**
+ * \file scorer_bench.cpp
+ * \author Kefei Lu
+ * \brief Check and benchmark of a scorer generated by export_scorer.
+ *
+ * Built with bench/scorer_model.h, generated from a model trained on an
+ * arff file (see the Makefile). Trains the same NaiveBayesClassifier on
+ * the same file, on the attributes of the header, then:
+ *   - checks that the generated classify() and log_likelihood() agree
+ *     with classify_inst() and log_likelihood() on every instance;
+ *   - times classify_inst(), CompiledModel::classify_batch() and the
+ *     generated classify(), in instances per second.
+ * Exits with 1 if they disagree.
+ *
+ * Usage: scorer_bench [-d] [file.arff [repeat]]
+ * -d if the header was exported from a discretized model.
+ */
+
+#include "../common.h"
+#include "../dataset.h"
+#include "../classifier.h"
+#include "../compiledmodel.h"
+#include "scorer_model.h"
+#include <sys/time.h>
+
+/** |a - b| of two log likelihoods: 0 if both are NaN, HUGE_VAL if only
+ * one is. */
+static double
+log_difference(const double a, const double b)
+{
+    if (a == b || (a != a && b != b)) return 0;
+    if (a != a || b != b) return HUGE_VAL;
+    return fabs(a - b);
+}
+
+static double
+now()
+{
+    timeval t;
+    gettimeofday(&t, NULL);
+    return t.tv_sec + t.tv_usec * 1e-6;
+}
+
+int main(int argc, char** argv)
+{
+    bool discrete = 0;
+    if (argc > 1 && strcmp(argv[1], "-d") == 0) {
+	discrete = 1;
+	argc --;
+	argv ++;
+    }
+    const char* file = argc > 1 ? argv[1] : "test.arff";
+    const size_t repeat = argc > 2 ? atoi(argv[2]) : 10;
+    Dataset ds(file);
+    if (ds.num_of_att() != scorer_model::N_SCHEMA_ATT) {
+	fprintf(stderr, "(E) %s is not of the schema of the scorer.\n", file);
+	return 1;
+    }
+    NaiveBayesClassifier* c = discrete ?
+	new NaiveBayesClassifierDiscrete(ds, scorer_model::CLASS_INDEX) :
+	new NaiveBayesClassifier(ds, scorer_model::CLASS_INDEX);
+    c->only_these_att().assign(scorer_model::ATT,
+	    scorer_model::ATT + scorer_model::N_ATT);
+    c->useAllAtt() = 0;
+    c->train();
+
+    // The inputs of the generated scorer.
+    const size_t nInst = ds.num_of_inst();
+    const size_t nAtt = scorer_model::N_ATT;
+    const size_t nClass = scorer_model::N_CLASS;
+    vector<double> x(nInst*nAtt);
+    for (size_t i=0;i<nInst;i++) {
+	for (size_t k=0;k<nAtt;k++) {
+	    const size_t a = scorer_model::ATT[k];
+	    const Attribute att = ds[i][a];
+	    double& v = x[i*nAtt+k];
+	    if (att.unknown) v = NAN;
+	    else if (ds.get_att_desc(a).get_type() == ATT_TYPE_NUMERIC) v = att.value.num;
+	    else v = (double)att.value.nom;
+	}
+    }
+
+    // Agreement.
+    size_t nDiff = 0;
+    double maxDiff = 0;
+    vector<double> logL(nClass);
+    for (size_t i=0;i<nInst;i++) {
+	if (scorer_model::classify(&x[i*nAtt]) != c->classify_inst(ds[i])) nDiff ++;
+	scorer_model::log_likelihood(&x[i*nAtt], &logL[0]);
+	for (size_t j=0;j<nClass;j++) {
+	    maxDiff = max(maxDiff, log_difference(c->log_likelihood(j, ds[i]), logL[j]));
+	}
+    }
+    fprintf(stdout, "%d instances, %d classes, %d attributes: "
+	    "%d predictions differ, max |log likelihood difference| %g\n",
+	    (int)nInst, (int)nClass, (int)nAtt, (int)nDiff, maxDiff);
+
+    // Speed.
+    size_t sink = 0;
+    double t0 = now();
+    for (size_t r=0;r<repeat;r++) {
+	for (size_t i=0;i<nInst;i++) sink += c->classify_inst(ds[i]);
+    }
+    const double tInst = now() - t0;
+
+    const CompiledModel model(*c);
+    vector<size_t> rows(nInst);
+    for (size_t i=0;i<nInst;i++) rows[i] = i;
+    vector<NominalType> label(nInst);
+    t0 = now();
+    for (size_t r=0;r<repeat;r++) {
+	model.classify_batch(ds, &rows[0], nInst, &label[0]);
+	sink += label[0];
+    }
+    const double tBatch = now() - t0;
+
+    t0 = now();
+    for (size_t r=0;r<repeat;r++) {
+	for (size_t i=0;i<nInst;i++) sink += scorer_model::classify(&x[i*nAtt]);
+    }
+    const double tGen = now() - t0;
+
+    const double n = (double)nInst * repeat;
+    fprintf(stdout, "classify_inst           %12.0f inst/s\n", n / tInst);
+    fprintf(stdout, "CompiledModel batch     %12.0f inst/s\n", n / tBatch);
+    fprintf(stdout, "generated classify      %12.0f inst/s (%.1fx classify_inst)\n",
+	    n / tGen, tInst / tGen);
+    fprintf(stdout, "(checksum %d)\n", (int)sink);
+    delete c;
+    return nDiff || maxDiff != 0;
+}
@@ -5,6 +5,8 @@
  */
 
 #include "classifier.h"
+#include "compiledmodel.h"
+#include "parallel.h"
 
 #define PI 3.1415926
 #define __CLASSIFICATION_DEBUG__
@@ -19,6 +21,7 @@ Classifier::Classifier( const Dataset& dataset,
     _bindedDataset = &dataset;
     _classIndex = classIndex;
     _useAllAtt = useAllAtt;
+    _nThread = 0;
     //_seed = seed;
     _onlyTheseAtt.clear();
     perf_clear();
@@ -43,6 +46,43 @@ Classifier::init_tt_set(void)
     return;
 }
 
+/** A part of the test set, tested by one thread. */
+struct TestChunk {
+    size_t	begin;	///< of test_set()
+    size_t	end;
+    ConfMatr	conf;	///< the confusion matrix of this part
+};
+
+/** Everything the testing threads share. */
+struct TestJobs {
+    const Classifier*	c;
+    vector<TestChunk>	chunk;
+};
+
+static void
+test_chunk(const size_t i, void* arg)
+{
+    const TestJobs* jobs = (const TestJobs*)arg;
+    TestChunk& chunk = ((TestJobs*)arg)->chunk[i];
+    const Classifier& c = *jobs->c;
+    const size_t n = chunk.end - chunk.begin;
+    vector<NominalType> label(n);
+    c.classify_batch(&c.test_set()[chunk.begin], n, &label[0]);
+    const Column& klass = c.dataset().column(c.class_index());
+    for( size_t i=0;i<n;i++ ) {
+#ifdef __CLASSIFICATION_DEBUG__
+#ifdef   __CLASSIFICATION_DEBUG_VERBOSE__
+	fprintf(stdout, "(D) Testing %d-th instance.\n", (int)(chunk.begin+i+1));
+#endif
+#endif
+	const Attribute cl = klass[c.test_set()[chunk.begin+i]];
+
+	if (cl.unknown) continue;
+
+	chunk.conf[label[i]][cl.value.nom] ++ ;
+    }
+}
+
 void 
 Classifier::test(void)
 {
@@ -66,20 +106,24 @@ Classifier::test(void)
     trust().clear();
     trust().resize(nClass, 0);
 
-    // Begin testing
-    for( size_t i=0;i<nTest;i++ ) {
-#ifdef __CLASSIFICATION_DEBUG__
-#ifdef   __CLASSIFICATION_DEBUG_VERBOSE__
-	fprintf(stdout, "(D) Testing %d-th instance (total %d).\n",
-		i+1,nTest);
-#endif
-#endif
-	const Instance& inst = dataset()[test_set()[i]];
-	const size_t ci = class_index();
-
-	if (inst[ci].unknown) continue;
-
-	conf()[classify_inst(inst)][inst[ci].value.nom] ++ ;
+    // Begin testing, a part of the test set per thread.
+    size_t nThread = n_thread() ? n_thread() : num_of_cpu();
+    if (nThread > nTest) nThread = nTest;
+    TestJobs jobs;
+    jobs.c = this;
+    jobs.chunk.resize(nThread);
+    for (size_t i=0;i<nThread;i++) {
+	jobs.chunk[i].begin = nTest / nThread * i;
+	jobs.chunk[i].end = i == nThread-1 ? nTest : nTest / nThread * (i+1);
+	jobs.chunk[i].conf = conf();
+    }
+    run_parallel(test_chunk, &jobs, nThread, nThread);
+    for (size_t i=0;i<nThread;i++) {
+	for (size_t r=0;r<nClass;r++) {
+	    for (size_t c=0;c<nClass;c++) {
+		conf()[r][c] += jobs.chunk[i].conf[r][c];
+	    }
+	}
     }
 
     // Calculate accuracy:
@@ -159,30 +203,115 @@ show_trust(const Classifier& c,const vector<double>& trust)
     }
 }
 
+void
+Classifier::
+classify_batch(const size_t* rows, const size_t n, NominalType* label, 
+	double* posterior) const
+{
+    const size_t nClass = get_class_desc().possible_value_vector().size();
+    for (size_t i=0;i<n;i++) {
+	label[i] = classify_inst(dataset()[rows[i]]);
+	if (!posterior) continue;
+	for (size_t c=0;c<nClass;c++) {
+	    posterior[i*nClass+c] = c == label[i] ? 1 : 0;
+	}
+    }
+}
+
+void
+Classifier::
+classify_batch(const size_t first, const size_t n, NominalType* label, 
+	double* posterior) const
+{
+    assert(first + n <= dataset().num_of_inst());
+    vector<size_t> rows(n);
+    for (size_t i=0;i<n;i++) {
+	rows[i] = first + i;
+    }
+    if (n) classify_batch(&rows[0], n, label, posterior);
+}
+
+NominalType
+argmax_log_likelihood(const double* logL, const size_t nClass, 
+	double* posterior)
+{
+    size_t curMaxClassIndex = 0;
+    double curMax = -HUGE_VAL;
+    for (size_t c=0;c<nClass;c++) {
+	if (logL[c] > curMax) {
+	    curMax = logL[c];
+	    curMaxClassIndex = c;
+	}
+    }
+    if (posterior) {
+	// posterior[c] = exp(logL[c] - max) / sum_i exp(logL[i] - max)
+	double sum = 0;
+	for (size_t c=0;c<nClass;c++) {
+	    posterior[c] = curMax == -HUGE_VAL ? 0 : exp(logL[c] - curMax);
+	    sum += posterior[c];
+	}
+	for (size_t c=0;c<nClass && sum>0;c++) {
+	    posterior[c] /= sum;
+	}
+    }
+    return curMaxClassIndex;
+}
+
+void
+StatisticsClassifier::
+classify_batch(const size_t* rows, const size_t n, NominalType* label, 
+	double* posterior) const
+{
+    refresh();
+    const size_t nClass = get_class_desc().possible_value_vector().size();
+    vector<double> logL(nClass);
+    for (size_t i=0;i<n;i++) {
+	const InstanceRef inst = dataset()[rows[i]];
+	for (size_t c=0;c<nClass;c++) {
+	    logL[c] = log_likelihood(c, inst);
+	}
+	label[i] = argmax_log_likelihood(&logL[0], nClass, 
+		posterior ? posterior + i*nClass : NULL);
+    }
+}
+
 NominalType 
 StatisticsClassifier::
-classify_inst(const Instance& inst, double* maxProb) const 
+classify_inst(const InstanceRef& inst, double* maxProb) const 
 {
+    refresh();
     const size_t nClass = 
 	dataset().get_att_desc( class_index() ).possible_value_vector().size();
+    // Compare the likelihoods in log space: their products underflow on 
+    // many attributes, and would all be 0.
     size_t curMaxClassIndex = 0;
-    double curMaxProb = -1;
+    double curMax = -HUGE_VAL;
     double tmp=0;
     if (maxProb) {
+	vector<double> logL(nClass);
 	for( size_t i=0;i<nClass;i++ ) {
-	    tmp = a_posteriori(i, inst);
-	    if ( tmp > curMaxProb ) {
-		curMaxProb = tmp;
+	    logL[i] = log_likelihood(i, inst);
+	    if ( logL[i] > curMax ) {
+		curMax = logL[i];
 		curMaxClassIndex = i;
 	    }
 	}
-	*maxProb = curMaxProb;
+	// a posteriori = 1 / sum_i exp(logL[i] - max)
+	if (curMax == -HUGE_VAL) {
+	    *maxProb = 0;
+	} else {
+	    double sum = 0;
+	    for( size_t i=0;i<nClass;i++ ) {
+		sum += exp(logL[i] - curMax);
+	    }
+	    *maxProb = 1 / sum;
+	}
     }
     else {
 	for( size_t i=0;i<nClass;i++ ) {
-	    tmp = likelihood(i, inst);
-	    if ( tmp > curMaxProb ) {
-		curMaxProb = tmp;
+	    tmp = log_likelihood(i, inst);
+	    if ( tmp > curMax ) {
+		curMax = tmp;
 		curMaxClassIndex = i;
 	    }
 	}
@@ -193,65 +322,55 @@ classify_inst(const Instance& inst, double* maxProb) const
 inline
 double
 StatisticsClassifier::
-likelihood(const NominalType c, const Instance& inst) const 
+likelihood(const NominalType c, const InstanceRef& inst) const 
 {
+    refresh();
     return prob_inst_on_class(inst,c) * pClass()[c];
 }
 
+double
+StatisticsClassifier::
+log_likelihood(const NominalType c, const InstanceRef& inst) const 
+{
+    refresh();
+    if (pClass()[c] == 0) return -HUGE_VAL;
+    return log_prob_inst_on_class(inst,c) + log(pClass()[c]);
+}
+
 double 
 StatisticsClassifier::
-a_posteriori(const NominalType c, const Instance& inst) const 
+a_posteriori(const NominalType c, const InstanceRef& inst) const 
 {
+    refresh();
     const size_t nClass = get_class_desc().possible_value_vector().size();
-    double pInst = 0;
+    const double logLc = log_likelihood(c, inst);
+    if (logLc == -HUGE_VAL) return 0;
+    // Normalized in log space: 1 / sum_i exp(logL[i] - logL[c])
+    double sum = 0;
     for (size_t i=0;i<nClass;i++) {
-	pInst += prob_inst_on_class(inst,i) * pClass()[i];
+	sum += exp(log_likelihood(i, inst) - logLc);
     }
-    return likelihood(c,inst) / pInst;
+    return 1 / sum;
 }
 
-double
-StatisticsClassifier::
-est_class_prob(const size_t c_index) const
+double 
+NaiveBayesClassifier::
+att_prob_on_class(const ValueType& value, const size_t att_i, const size_t class_j) const
 {
-    assert(!train_set().empty());
-    assert(!test_set().empty());
-
-    const AttDesc & classDesc = get_class_desc();
-    size_t nClass = classDesc.possible_value_vector().size();
-    assert(c_index<nClass);
+    // Check if train() has been called before.
+    assert(!pClass().empty());
 
-    // count num of instance belongs to class i:
-    const size_t nTrain = train_set().size();
-    size_t sum = 0;
-    // for each inst in train set
-    for ( size_t j=0;j<nTrain;j++ ) {
-	const Attribute& c = dataset()[train_set()[j]][this->class_index()];
-	if (c.unknown) {continue;}
-	if (c.value.nom == c_index) {sum ++;}
-    }
-    /** Handling zero-instance issue (no inst. belongs to this class). */
-    if (sum==0) {
-	fprintf(stderr, "(W) No Training instance belongs to class %s (%d). "
-		"Probability set to 0.\n",
-		get_class_desc().map(c_index).c_str(), c_index);
-	return 0.0;
-    }
-    return sum/(double)nTrain;
+    return _attDistrOnClass.prob(value, att_i, class_j);
 }
 
 double 
 NaiveBayesClassifier::
-att_prob_on_class(const ValueType& value, const size_t att_i, const size_t class_j) const
+att_log_prob_on_class(const ValueType& value, const size_t att_i, const size_t class_j) const
 {
-    // Check if training/testing set has been specified before.
-    assert(!train_set().empty());
-    assert(!test_set().empty());
-
     // Check if train() has been called before.
     assert(!pClass().empty());
 
-    return _attDistrOnClass.prob(value, att_i, class_j);
+    return _attDistrOnClass.log_prob(value, att_i, class_j);
 }
 
 void 
@@ -262,164 +381,194 @@ train(void)
     assert(!train_set().empty());
     assert(!test_set().empty());
 
-    // Obtaining _pClass:
-    pClass().clear();
+    // Obtaining _pClass, in one pass:
+    // count num of instance belongs to each class.
     size_t nClass = get_class_desc().possible_value_vector().size();
+    const size_t nTrain = train_set().size();
+    const Column& klass = dataset().column(class_index());
+    vector<size_t> count(nClass, 0);
+    for ( size_t j=0;j<nTrain;j++ ) {
+	const Attribute c = klass[train_set()[j]];
+	if (c.unknown) {continue;}
+	count[c.value.nom] ++;
+    }
+    set_class_prob(count, nTrain);
+}
+
+void
+StatisticsClassifier::
+set_class_prob(const vector<size_t>& count, const size_t n)
+{
+    const size_t nClass = get_class_desc().possible_value_vector().size();
+    assert(count.size() == nClass);
+    pClass().clear();
     for ( size_t i=0;i<nClass;i++ ) {
-	pClass().push_back( est_class_prob(i) );
+	/** Handling zero-instance issue (no inst. belongs to this class). */
+	if (count[i]==0) {
+	    fprintf(stderr, "(W) No Training instance belongs to class %s (%lu). "
+		    "Probability set to 0.\n",
+		    get_class_desc().map(i).c_str(), (unsigned long)i);
+	    pClass().push_back(0.0);
+	    continue;
+	}
+	pClass().push_back(count[i]/(double)n);
     }
 #ifdef __CLASSIFICATION_DEBUG__
+    show_class_prob();
+#endif
+}
+
+void
+StatisticsClassifier::
+show_class_prob(void) const
+{
+    const size_t nClass = pClass().size();
     fprintf(stdout, "(I) Priori probability of class:\n");
     for (size_t i=0;i<nClass;i++) {
 	fprintf(stdout, "(I) ... %.7f (%s)\n",
 		pClass().at(i), get_class_desc().map(i).c_str() );
     }
-#endif
 }
 
 void
 NaiveBayesClassifier::
 train(void)
 {
-    StatisticsClassifier::train();
     fprintf(stdout, "(I) NaiveBayesClassifier: Training the model...\n");
 
     assert(!train_set().empty());
     assert(!test_set().empty());
 
-    // Obtaining _attDistrOnClass:
-    const size_t nAtt = dataset().num_of_att();
-    const size_t ci = class_index();
-    size_t nClass = get_class_desc().possible_value_vector().size();
-    for ( size_t i=0; i<nAtt; i++ ) {
-#ifdef __CLASSIFICATION_DEBUG__
-#ifdef   __CLASSIFICATION_DEBUG_VERBOSE__
-	fprintf(stdout, "(D) NaiveBayesClassifier: training on %d-th attribute (total: %d).\n", i+1, nAtt);
-#endif
-#endif
-	if ( i == ci ) continue;
-	for ( size_t j=0; j<nClass; j++ ) {
-	    calc_distr_for_att_on_class(i,j);
-	}
-    }
+    _stat.init(dataset(), class_index());
+    _stat.add(dataset(), train_set());
+    _stat.estimate(*this);
+    _stale = 0;
+    drop_compiled();
 }
 
-//Distribution* 
 void
 NaiveBayesClassifier::
-calc_distr_for_att_on_class(size_t att_i, size_t class_j)
+train(const NaiveBayesStatistics& stat)
 {
-    const Dataset& ds = dataset();
-    const size_t nInst = ds.num_of_inst();
-    const size_t ci = class_index();
-    //const size_t nClass = ds.get_att_desc(ci).possible_value_vector().size();
+    fprintf(stdout, "(I) NaiveBayesClassifier: Training the model from statistics...\n");
+    _stat = stat;
+    _stat.estimate(*this);
+    _stale = 0;
+    drop_compiled();
+}
 
-    // att_i is not the class attribute:
-    if (att_i == ci) {
-	fprintf(stderr, "(E) Attribute must not be the class attribute.\n");
-	exit(1);
-    }
+/** Exit if the model of c cannot be updated by instance. */
+static void
+check_additive(const NaiveBayesClassifier& c)
+{
+    if (c.additive()) return;
+    fprintf(stderr, "(E) NaiveBayesClassifier: This model cannot add or "
+	    "remove instances.\n");
+    exit(1);
+}
 
-    // This value to later store the new'd distribution 
-    // and will be returned.
-    //Distribution* pDistr = NULL;
-    Distribution*& pDistr = attDistrOnClass().table()[class_j][att_i];
-    // find type of this att:
-    const AttDesc& desc = ds.get_att_desc(att_i);
-    if (desc.get_type() == ATT_TYPE_NUMERIC) {
-	//pDistr = new NormalDistribution;
-	double sum=0;
-	double sq_sum=0;
-	size_t nInstBelongsToThisClass=0;
-	for (size_t i=0;i<nInst;i++) {
-	    const Attribute& klass = ds[i][ci];
-	    const Attribute& att = ds[i][att_i];
-	    if (klass.unknown) continue;
-	    if (att.unknown) continue;
-	    if (klass.value.nom != class_j) continue;
-	    sum += att.value.num;
-	    sq_sum += pow(att.value.num,2);
-	    nInstBelongsToThisClass ++;
-	}
-	if (nInstBelongsToThisClass==0) {
-	    /** When no instances belongs to this class, the _pClass should have 
-	     * been already set to 0. Set the corresponding conditional probability 
-	     * to invalid to indicate that when evaluating this conditional 
-	     * probability, 0 should be returned. */
-	    ((NormalDistribution*)pDistr)->invalid() = 1;
-	    return;
-	}
-	double meantmp = sum/nInstBelongsToThisClass;
-	((NormalDistribution*)pDistr)->mean() = meantmp;
-	((NormalDistribution*)pDistr)->var() = 
-	    1.0 / (nInstBelongsToThisClass-1) *
-	    (
-	      sq_sum 
-	      + nInstBelongsToThisClass * pow(meantmp,2.0)
-	      - 2 * meantmp * sum
-	    );
-	return;
+void
+NaiveBayesClassifier::
+add_instance(const InstanceRef& inst)
+{
+    check_additive(*this);
+    if (!_stat.initialized()) _stat.init(dataset(), class_index());
+    _stat.add(inst);
+    _stale = 1;
+}
+
+void
+NaiveBayesClassifier::
+remove_instance(const InstanceRef& inst)
+{
+    check_additive(*this);
+    assert(_stat.initialized());
+    _stat.remove(inst);
+    _stale = 1;
+}
+
+void
+NaiveBayesClassifier::
+add_instances(const Dataset& ds, const vector<size_t>& rows)
+{
+    check_additive(*this);
+    assert(ds.num_of_att() == dataset().num_of_att());
+    if (!_stat.initialized()) _stat.init(dataset(), class_index());
+    _stat.add(ds, rows);
+    _stale = 1;
+}
+
+void
+NaiveBayesClassifier::
+remove_instances(const Dataset& ds, const vector<size_t>& rows)
+{
+    check_additive(*this);
+    assert(ds.num_of_att() == dataset().num_of_att());
+    assert(_stat.initialized());
+    NaiveBayesStatistics stat;
+    stat.init(dataset(), class_index());
+    stat.add(ds, rows);
+    _stat -= stat;
+    _stale = 1;
+}
+
+void
+NaiveBayesClassifier::
+refresh(void) const
+{
+    // The acquire pairs with the release below: a thread which sees 
+    // the model fresh sees it estimated.
+    if (!__atomic_load_n(&_stale, __ATOMIC_ACQUIRE)) return;
+    _refreshLock.lock();
+    if (__atomic_load_n(&_stale, __ATOMIC_RELAXED)) {
+	fprintf(stdout, "(I) NaiveBayesClassifier: Refreshing the model...\n");
+	_stat.estimate(const_cast<NaiveBayesClassifier&>(*this));
+	drop_compiled();
+	__atomic_store_n(&_stale, false, __ATOMIC_RELEASE);
     }
-    else if (desc.get_type() == ATT_TYPE_NOMINAL) {
-	//pDistr = new NominalDistribution;
-	size_t nPos = ds.get_att_desc(att_i).possible_value_vector().size();
-	((NominalDistribution*)pDistr)->pmf().resize(nPos,0.0);
-	size_t sum = 0; // total num of inst belongs to class_j
-	for (size_t i=0;i<nInst;i++) {
-	    const Attribute& klass = ds[i][ci];
-	    const Attribute& att = ds[i][att_i];
-	    if (klass.unknown) continue;
-	    if (att.unknown) continue;
-	    if (klass.value.nom != class_j) continue;
-	    sum ++;
-	    ((NominalDistribution*)pDistr)->pmf()[att.value.nom] ++;
-	}
-	// Handle zero sum issue and so on.
-	bool zero_issue=0;
-	if (sum==0) {
-	    /** When no instances belongs to this class, for Nominal type attributes, 
-	     * we can assume the possible values of this attribute is equally likely 
-	     * to be chosen. So this zero-instance issue can be addressed the same 
-	     * way as the zero possibility issue stated as later. So simply set zero_issue 
-	     * flags to 1. */
-	    zero_issue = 1;
-	}
-	for (size_t i=0;i<nPos;i++) {
-	    if ( ((NominalDistribution*)pDistr)->pmf()[i] != 0 )
-		continue;
-	    zero_issue = 1;
-	}
-	/** Handle the zero possibility issue.
-	 *
-	 * p{A_j|C_i} = N(A_j,C_i) / N(C_i)
-	 *
-	 * if N(A_j,C_i) == 0, means there's no such instance
-	 * having A_j value and belongs to class C_i.
-	 * This can be handled as:
-	 *
-	 * \verbatim
-	                N(A_j,C_i) + 1
-	 p{A_j|C_i} = ----------------- ,
-	                N(C_i) + nPos
-	   \endverbatim
-	 *
-	 * where nPos is the num of possible values of this 
-	 * attribute.
-	 *
-	 * For example, 0/3, 3/3 will become 1/5, 4/5; 
-	 * 0/3, 1/3, 2/3 will become 1/6, 2/6, 3/6. */
-	for (size_t i=0;i<nPos;i++) {
-	    if (!zero_issue) {
-		((NominalDistribution*)pDistr)->pmf()[i] /= (double)sum;
-	    } else {
-		((NominalDistribution*)pDistr)->pmf()[i] = (double)(((NominalDistribution*)pDistr)->pmf()[i] + 1) / (sum + nPos);
-	    }
+    _refreshLock.unlock();
+}
+
+Classifier*
+NaiveBayesClassifier::
+clone(void) const
+{
+    NaiveBayesClassifier* c = 
+	new NaiveBayesClassifier(dataset(), class_index(), useAllAtt());
+    c->only_these_att() = only_these_att();
+    c->n_thread() = n_thread();
+    return c;
+}
+
+void
+NaiveBayesClassifier::
+classify_batch(const size_t* rows, const size_t n, NominalType* label, 
+	double* posterior) const
+{
+    refresh();
+    // Several threads may classify at the same time: the first one 
+    // compiles the model, the others wait for it.
+    const CompiledModel* model = __atomic_load_n(&_compiled, __ATOMIC_ACQUIRE);
+    if (!model) {
+	_compileLock.lock();
+	model = _compiled;
+	if (!model) {
+	    CompiledModel* m = new CompiledModel(*this);
+	    __atomic_store_n(&_compiled, m, __ATOMIC_RELEASE);
+	    model = m;
 	}
-	return;
+	_compileLock.unlock();
     }
-    fprintf(stderr, "(E) Unsupported attribute type: %s(%d).\n",
-	    desc.map(desc.get_type()).c_str(),desc.get_type());
-    exit(1);
+    CompiledModel::Scratch scratch;
+    model->classify_batch(dataset(), rows, n, label, scratch, posterior);
+}
+
+void
+NaiveBayesClassifier::
+drop_compiled(void) const
+{
+    delete _compiled;
+    _compiled = NULL;
 }
 
 void 
@@ -428,12 +577,17 @@ bind_dataset(const Dataset& dataset)
 {
     Classifier::bind_dataset(dataset);
     attDistrOnClass().init_table();
+    // The statistics were of the old dataset.
+    _stat = NaiveBayesStatistics();
+    _stale = 0;
+    drop_compiled();
 }
 
 const double 
 NaiveBayesClassifier::
-prob_inst_on_class( const Instance& inst, const NominalType c ) const
+prob_inst_on_class( const InstanceRef& inst, const NominalType c ) const
 {
+    refresh();
     const size_t nAtt = dataset().num_of_att();
     const size_t ci = class_index();
     double product = 1;
@@ -455,6 +609,34 @@ prob_inst_on_class( const Instance& inst, const NominalType c ) const
     return product;
 }
 
+const double 
+NaiveBayesClassifier::
+log_prob_inst_on_class( const InstanceRef& inst, const NominalType c ) const
+{
+    refresh();
+    const size_t nAtt = dataset().num_of_att();
+    const size_t ci = class_index();
+    double sum = 0;
+    if ( useAllAtt() ) {
+	for (size_t i=0;i<nAtt;i++) {
+	    if (ci == i) continue;
+	    const Attribute att = inst[i];
+	    if (att.unknown) continue;
+	    sum += att_log_prob_on_class(att.value, i, c);
+	}
+    }
+    else {
+	for (size_t i=0;i<only_these_att().size();i++) {
+	    size_t ii = only_these_att().at(i);
+	    if (ci == ii) continue;
+	    const Attribute att = inst[ii];
+	    if (att.unknown) continue;
+	    sum += att_log_prob_on_class(att.value, ii, c);
+	}
+    }
+    return sum;
+}
+
 void
 AttDistrOnClass::
 init_table(void)
@@ -465,20 +647,21 @@ init_table(void)
     }
 
     const Classifier & c = classifier();
-    size_t nAtt = c.dataset().num_of_att() - 1;
+    size_t nAtt = c.dataset().num_of_att();
     size_t cIndex = c.class_index();
     size_t nClass = c.get_class_desc().possible_value_vector().size();
 
     {
-	Distribution* tmp;
+	Distribution* tmp = NULL;
 	table().clear();
 	table().resize(nClass);
 	for (size_t j=0;j<nClass;j++) {
 	    table()[j].clear();
-	    table()[j].resize(nAtt);
-	    for (size_t i=0;i<nAtt+1;i++) {
+	    table()[j].resize(nAtt, NULL);
+	    for (size_t i=0;i<nAtt;i++) {
 		if (i==cIndex) continue;
 		const AttDesc& desc = c.dataset().get_att_desc(i);
+		tmp = NULL;
 		if (desc.get_type() == ATT_TYPE_NUMERIC) {
 		    tmp = new NormalDistribution;
 		}
@@ -515,6 +698,368 @@ AttDistrOnClass::
     return;
 }
 
+void
+NormalDistribution::
+fit(const RunningMoments& m)
+{
+    const size_t n = m.n();
+    if (n==0) {
+	/** When no instances belongs to this class, the _pClass should have 
+	 * been already set to 0. Set the corresponding conditional probability 
+	 * to invalid to indicate that when evaluating this conditional 
+	 * probability, 0 should be returned. */
+	invalid() = 1;
+	return;
+    }
+    invalid() = 0;
+    mean() = m.mean();
+    var() = 1.0 / (n-1) * m.m2();
+    precompute();
+}
+
+void
+NormalDistribution::
+precompute(void)
+{
+    _logNorm = -0.5 * log(2*PI*var());
+    _halfInvVar = 0.5 / var();
+}
+
+void
+NominalDistribution::
+fit(const vector<size_t>& count)
+{
+    const size_t nPos = count.size();
+    size_t sum = 0; // total num of inst belongs to class_j
+    for (size_t i=0;i<nPos;i++) {
+	sum += count[i];
+    }
+    // Handle zero sum issue and so on.
+    bool zero_issue=0;
+    if (sum==0) {
+	/** When no instances belongs to this class, for Nominal type attributes, 
+	 * we can assume the possible values of this attribute is equally likely 
+	 * to be chosen. So this zero-instance issue can be addressed the same 
+	 * way as the zero possibility issue stated as later. So simply set zero_issue 
+	 * flags to 1. */
+	zero_issue = 1;
+    }
+    for (size_t i=0;i<nPos;i++) {
+	if ( count[i] != 0 )
+	    continue;
+	zero_issue = 1;
+    }
+    /** Handle the zero possibility issue.
+     *
+     * p{A_j|C_i} = N(A_j,C_i) / N(C_i)
+     *
+     * if N(A_j,C_i) == 0, means there's no such instance
+     * having A_j value and belongs to class C_i.
+     * This can be handled as:
+     *
+     * \verbatim
+                    N(A_j,C_i) + 1
+     p{A_j|C_i} = ----------------- ,
+                    N(C_i) + nPos
+       \endverbatim
+     *
+     * where nPos is the num of possible values of this 
+     * attribute.
+     *
+     * For example, 0/3, 3/3 will become 1/5, 4/5; 
+     * 0/3, 1/3, 2/3 will become 1/6, 2/6, 3/6. */
+    pmf().resize(nPos);
+    for (size_t i=0;i<nPos;i++) {
+	if (!zero_issue) {
+	    pmf()[i] = count[i] / (double)sum;
+	} else {
+	    pmf()[i] = (double)(count[i] + 1) / (sum + nPos);
+	}
+    }
+    precompute();
+}
+
+void
+NominalDistribution::
+precompute(void)
+{
+    _logPmf.resize(pmf().size());
+    for (size_t i=0;i<pmf().size();i++) {
+	_logPmf[i] = pmf()[i] > 0 ? log(pmf()[i]) : -HUGE_VAL;
+    }
+}
+
+RunningMoments&
+RunningMoments::
+operator+=(const RunningMoments& o)
+{
+    if (o._n == 0) return *this;
+    if (_n == 0) {
+	*this = o;
+	return *this;
+    }
+    const size_t n = _n + o._n;
+    const double d = o._mean - _mean;
+    _mean += d * o._n / n;
+    _m2 += o._m2 + d * d * ((double)_n * o._n / n);
+    _n = n;
+    return *this;
+}
+
+RunningMoments&
+RunningMoments::
+operator-=(const RunningMoments& o)
+{
+    if (o._n == 0) return *this;
+    assert(o._n <= _n);
+    const size_t n = _n - o._n;
+    if (n == 0) {
+	*this = RunningMoments();
+	return *this;
+    }
+    const double mean = _mean - (o._mean - _mean) * o._n / n;
+    const double d = o._mean - mean;
+    _m2 -= o._m2 + d * d * ((double)n * o._n / _n);
+    if (_m2 < 0) _m2 = 0;
+    _mean = mean;
+    _n = n;
+    return *this;
+}
+
+void
+NaiveBayesStatistics::
+init(const Dataset& schema, const size_t classIndex)
+{
+    _nAtt = schema.num_of_att();
+    _classIndex = classIndex;
+    const AttDesc& classDesc = schema.get_att_desc(classIndex);
+    const size_t nClass = classDesc.possible_value_vector().size();
+    _nInst = 0;
+    _nClass.assign(nClass, 0);
+    _moments.assign(nClass*_nAtt, RunningMoments());
+    _hist.assign(nClass*_nAtt, vector<size_t>());
+    for (size_t c=0;c<nClass;c++) {
+	for (size_t a=0;a<_nAtt;a++) {
+	    const AttDesc& desc = schema.get_att_desc(a);
+	    if (a == classIndex) continue;
+	    if (desc.get_type() != ATT_TYPE_NOMINAL) continue;
+	    _hist[c*_nAtt+a].assign(desc.possible_value_vector().size(), 0);
+	}
+    }
+}
+
+void
+NaiveBayesStatistics::
+add(const InstanceRef& inst)
+{
+    _nInst ++;
+    const Attribute klass = inst[_classIndex];
+    if (klass.unknown) return;
+    const size_t c = klass.value.nom;
+    _nClass[c] ++;
+    for (size_t a=0;a<_nAtt;a++) {
+	if (a == _classIndex) continue;
+	const Attribute att = inst[a];
+	if (att.unknown) continue;
+	const size_t k = c*_nAtt+a;
+	if (_hist[k].empty()) {
+	    _moments[k].add(att.value.num);
+	} else {
+	    _hist[k][att.value.nom] ++;
+	}
+    }
+}
+
+void
+NaiveBayesStatistics::
+remove(const InstanceRef& inst)
+{
+    assert(_nInst > 0);
+    _nInst --;
+    const Attribute klass = inst[_classIndex];
+    if (klass.unknown) return;
+    const size_t c = klass.value.nom;
+    assert(_nClass[c] > 0);
+    _nClass[c] --;
+    for (size_t a=0;a<_nAtt;a++) {
+	if (a == _classIndex) continue;
+	const Attribute att = inst[a];
+	if (att.unknown) continue;
+	const size_t k = c*_nAtt+a;
+	if (_hist[k].empty()) {
+	    _moments[k].remove(att.value.num);
+	} else {
+	    assert(_hist[k][att.value.nom] > 0);
+	    _hist[k][att.value.nom] --;
+	}
+    }
+}
+
+void
+NaiveBayesStatistics::
+add(const Dataset& ds, const vector<size_t>& rows)
+{
+    // A few rows, as a test fold of a leave-one-out, are cheaper added 
+    // one by one than by a walk over the whole columns.
+    if (rows.size() * 8 < ds.num_of_inst()) {
+	for (size_t j=0;j<rows.size();j++) {
+	    add(ds[rows[j]]);
+	}
+	return;
+    }
+    const size_t nClass = _nClass.size();
+    // The class of each row in rows, -1 for the other rows and those 
+    // whose class is unknown.
+    vector<int32_t> rowClass(ds.num_of_inst(), -1);
+    vector<size_t> nRowOfClass(nClass, 0);
+    const Column& klass = ds.column(_classIndex);
+    for (size_t j=0;j<rows.size();j++) {
+	const size_t r = rows[j];
+	_nInst ++;
+	const Attribute c = klass[r];
+	if (c.unknown) continue;
+	rowClass[r] = c.value.nom;
+	nRowOfClass[c.value.nom] ++;
+    }
+    for (size_t c=0;c<nClass;c++) {
+	_nClass[c] += nRowOfClass[c];
+    }
+
+    const int32_t* cls = rowClass.empty() ? NULL : &rowClass[0];
+    const size_t nRow = rowClass.size();
+    // The moments of this column in each class, merged in at the end. 
+    // The values are added in row order, as add(const InstanceRef&) does.
+    vector<RunningMoments> moments(nClass);
+    vector<size_t> nStored(nClass);
+    for (size_t a=0;a<_nAtt;a++) {
+	if (a == _classIndex) continue;
+	const Column& att = ds.column(a);
+	const uint8_t* unknown = att.unknown().empty() ? NULL : &att.unknown()[0];
+	nStored.assign(nClass, 0);
+	if (att.type() == ATT_TYPE_NUMERIC) {
+	    moments.assign(nClass, RunningMoments());
+	    const NumericType* value = att.num().empty() ? NULL : &att.num()[0];
+	    if (att.sparse()) {
+		for (size_t k=0;k<att.row().size();k++) {
+		    const int32_t c = cls[att.row()[k]];
+		    if (c < 0) continue;
+		    nStored[c] ++;
+		    if (unknown[k]) continue;
+		    moments[c].add(value[k]);
+		}
+		for (size_t c=0;c<nClass;c++) {
+		    moments[c].add_zeros(nRowOfClass[c] - nStored[c]);
+		}
+	    } else {
+		for (size_t i=0;i<nRow;i++) {
+		    const int32_t c = cls[i];
+		    if (c < 0) continue;
+		    if (unknown[i]) continue;
+		    moments[c].add(value[i]);
+		}
+	    }
+	    for (size_t c=0;c<nClass;c++) {
+		_moments[c*_nAtt+a] += moments[c];
+	    }
+	} else {
+	    const NominalCode* value = att.nom().empty() ? NULL : &att.nom()[0];
+	    if (att.sparse()) {
+		for (size_t k=0;k<att.row().size();k++) {
+		    const int32_t c = cls[att.row()[k]];
+		    if (c < 0) continue;
+		    nStored[c] ++;
+		    if (unknown[k]) continue;
+		    _hist[c*_nAtt+a][value[k]] ++;
+		}
+		// The rest have the first possible value.
+		for (size_t c=0;c<nClass;c++) {
+		    _hist[c*_nAtt+a][0] += nRowOfClass[c] - nStored[c];
+		}
+	    } else {
+		for (size_t i=0;i<nRow;i++) {
+		    const int32_t c = cls[i];
+		    if (c < 0) continue;
+		    if (unknown[i]) continue;
+		    _hist[c*_nAtt+a][value[i]] ++;
+		}
+	    }
+	}
+    }
+}
+
+NaiveBayesStatistics&
+NaiveBayesStatistics::
+operator+=(const NaiveBayesStatistics& o)
+{
+    assert(o._nAtt == _nAtt && o._nClass.size() == _nClass.size());
+    _nInst += o._nInst;
+    for (size_t c=0;c<_nClass.size();c++) {
+	_nClass[c] += o._nClass[c];
+    }
+    for (size_t k=0;k<_moments.size();k++) {
+	_moments[k] += o._moments[k];
+	for (size_t v=0;v<_hist[k].size();v++) {
+	    _hist[k][v] += o._hist[k][v];
+	}
+    }
+    return *this;
+}
+
+NaiveBayesStatistics&
+NaiveBayesStatistics::
+operator-=(const NaiveBayesStatistics& o)
+{
+    assert(o._nAtt == _nAtt && o._nClass.size() == _nClass.size());
+    _nInst -= o._nInst;
+    for (size_t c=0;c<_nClass.size();c++) {
+	_nClass[c] -= o._nClass[c];
+    }
+    for (size_t k=0;k<_moments.size();k++) {
+	_moments[k] -= o._moments[k];
+	for (size_t v=0;v<_hist[k].size();v++) {
+	    _hist[k][v] -= o._hist[k][v];
+	}
+    }
+    return *this;
+}
+
+void
+NaiveBayesStatistics::
+estimate(NaiveBayesClassifier& c) const
+{
+    c.set_class_prob(_nClass, _nInst);
+    const size_t nClass = _nClass.size();
+    for (size_t j=0;j<nClass;j++) {
+	for (size_t a=0;a<_nAtt;a++) {
+	    if (a == _classIndex) continue;
+	    Distribution* pDistr = c.attDistrOnClass().table()[j][a];
+	    const size_t k = j*_nAtt+a;
+	    if (c.dataset().get_att_desc(a).get_type() == ATT_TYPE_NUMERIC) {
+		((NormalDistribution*)pDistr)->fit(_moments[k]);
+	    } else {
+		((NominalDistribution*)pDistr)->fit(_hist[k]);
+	    }
+	}
+    }
+}
+
+void
+NaiveBayesClassifier::
+train(InstanceStream& stream)
+{
+    fprintf(stdout, "(I) NaiveBayesClassifier: Training the model on a stream...\n");
+    assert(stream.schema().num_of_att() == dataset().num_of_att());
+
+    _stat.init(dataset(), class_index());
+    Instance inst;
+    while (stream.next(inst)) {
+	_stat.add(inst);
+    }
+    _stat.estimate(*this);
+    _stale = 0;
+    drop_compiled();
+}
+
 bool float_eq(const double v1, const double v2)
 {
     if (fabs(v1-v2) <= DBL_MIN) return 1;
@@ -532,3 +1077,442 @@ prob(const ValueType value) const
     }
     return (1.0/sqrt(2*PI*var())) * exp( - pow(value.num-mean(),2.0) / (2.0*var()) );
 }
+
+const double 
+NormalDistribution::
+log_prob(const ValueType value) const
+{
+    // The same cases as prob(), in log space.
+    if (invalid()) return -HUGE_VAL;
+    if ( float_eq(var(),0) ) {
+	if (float_eq(value.num,mean())) return log(1-DBL_MIN);
+	return log(DBL_MIN);
+    }
+    const double d = value.num - mean();
+    return _logNorm - d * d * _halfInvVar;
+}
+
+const double KernelDistribution::CUTOFF = 6;
+const size_t KernelDistribution::DIRECT = 8;
+
+/** The bandwidth for the sorted values by rule, 0 if they are all the same. */
+static double
+kernel_bandwidth(const vector<double>& sorted, const KernelDistribution::Bandwidth rule)
+{
+    const size_t n = sorted.size();
+    const double range = sorted[n-1] - sorted[0];
+    if (rule == KernelDistribution::BANDWIDTH_JOHN_LANGLEY) {
+	return range / sqrt((double)n);
+    }
+    RunningMoments m;
+    for (size_t i=0;i<n;i++) {
+	m.add(sorted[i]);
+    }
+    const double sd = n > 1 ? sqrt(m.m2() / (n-1)) : 0;
+    const double n5 = pow((double)n, -0.2);
+    if (rule == KernelDistribution::BANDWIDTH_SCOTT) {
+	return 1.06 * sd * n5;
+    }
+    const double iqr = sorted[(3*n)/4] - sorted[n/4];
+    const double spread = iqr > 0 ? min(sd, iqr/1.34) : sd;
+    return 0.9 * spread * n5;
+}
+
+void
+KernelDistribution::
+fit(vector<double>& values, const Bandwidth rule, const size_t gridSize)
+{
+    _cluster.clear();
+    _logDensity.clear();
+    _value.clear();
+    const size_t n = values.size();
+    if (n==0) {
+	// No instance of this class, as NormalDistribution::fit().
+	_invalid = 1;
+	return;
+    }
+    _invalid = 0;
+    sort(values.begin(), values.end());
+    _min = values[0];
+    _max = values[n-1];
+    const double h = kernel_bandwidth(values, rule);
+    _point = !(h > 0) || float_eq(_max, _min);
+    if (_point) return;
+    _h = h;
+    _logPeak = -log(n * h * sqrt(2*PI));
+
+    // Split the values where the kernels of two of them do not meet.
+    const double cut = CUTOFF*h;
+    for (size_t i=0;i<n;) {
+	size_t j = i+1;
+	while (j < n && values[j] - values[j-1] <= 2*cut) j++;
+	Cluster c;
+	c.lo = values[i] - cut;
+	c.hi = values[j-1] + cut;
+	if (j - i <= DIRECT) {
+	    c.invStep = 0;
+	    c.first = _value.size();
+	    c.n = j - i;
+	    _value.insert(_value.end(), values.begin()+i, values.begin()+j);
+	} else {
+	    tabulate(&values[i], j - i, c, gridSize);
+	}
+	_cluster.push_back(c);
+	i = j;
+    }
+}
+
+void
+KernelDistribution::
+tabulate(const double* v, const size_t n, Cluster& c, const size_t gridSize)
+{
+    // The grid is no finer than a quarter of the bandwidth, and no 
+    // coarser than half of it.
+    const double h = _h;
+    const double width = c.hi - c.lo;
+    const double step = min(max(width / (max(gridSize, (size_t)2) - 1), h/8), h/4);
+    const size_t nGrid = (size_t)ceil(width / step) + 1;
+    c.invStep = 1 / step;
+    c.first = _logDensity.size();
+    c.n = nGrid;
+
+    // Linear binning: each value is shared by its two grid points.
+    vector<double> weight(nGrid, 0);
+    for (size_t i=0;i<n;i++) {
+	const double pos = (v[i] - c.lo) * c.invStep;
+	size_t j = (size_t)pos;
+	if (j > nGrid-2) j = nGrid-2;
+	const double f = pos - j;
+	weight[j] += 1 - f;
+	weight[j+1] += f;
+    }
+
+    // Convolve with the kernel, sampled at the grid points up to the 
+    // cut off, the step being a whole fraction of it when clamped.
+    const size_t nTap = (size_t)(CUTOFF * h * c.invStep + 1e-9);
+    vector<double> tap(nTap+1);
+    for (size_t t=0;t<=nTap;t++) {
+	const double d = t * step / h;
+	tap[t] = exp(_logPeak - 0.5*d*d);
+    }
+    // The kernel of one value at the cut off.
+    const double floor = exp(_logPeak - 0.5*CUTOFF*CUTOFF);
+    _logDensity.resize(c.first + nGrid);
+    double* logDensity = &_logDensity[c.first];
+    for (size_t j=0;j<nGrid;j++) {
+	double density = weight[j] * tap[0];
+	for (size_t t=1;t<=nTap;t++) {
+	    if (j >= t) density += weight[j-t] * tap[t];
+	    if (j+t < nGrid) density += weight[j+t] * tap[t];
+	}
+	logDensity[j] = log(max(density, floor));
+    }
+}
+
+const double 
+KernelDistribution::
+log_prob(const ValueType value) const
+{
+    if (_invalid) return -HUGE_VAL;
+    const double x = value.num;
+    if (_point) {
+	// As NormalDistribution::log_prob() of variance 0.
+	if (float_eq(x,_min)) return log(1-DBL_MIN);
+	return log(DBL_MIN);
+    }
+    const double logFloor = _logPeak - 0.5*CUTOFF*CUTOFF;
+    if (x < _cluster.front().lo || x > _cluster.back().hi) {
+	// Out of the clusters: the kernel of the nearest value.
+	const double d = (x - (x < _min ? _min : _max)) / _h;
+	return _logPeak - 0.5*d*d;
+    }
+    // The last cluster starting at x or before.
+    const Cluster& c = *(upper_bound(_cluster.begin(), _cluster.end(), x, 
+		starts_after) - 1);
+    if (x > c.hi) return logFloor;
+    if (c.invStep == 0) {
+	double sum = 0;
+	for (size_t i=c.first;i<c.first+c.n;i++) {
+	    const double d = (x - _value[i]) / _h;
+	    if (fabs(d) <= CUTOFF) sum += exp(-0.5*d*d);
+	}
+	return sum > 0 ? max(_logPeak + log(sum), logFloor) : logFloor;
+    }
+    const double pos = (x - c.lo) * c.invStep;
+    size_t j = (size_t)pos;
+    if (j > c.n-2) j = c.n-2;
+    const double f = pos - j;
+    const double* logDensity = &_logDensity[c.first];
+    return logDensity[j] + f * (logDensity[j+1] - logDensity[j]);
+}
+
+const double 
+KernelDistribution::
+prob(const ValueType value) const
+{
+    if (_invalid) return .0;
+    if (_point) {
+	if (float_eq(value.num,_min)) return 1-DBL_MIN;
+	return DBL_MIN;
+    }
+    return exp(log_prob(value));
+}
+
+double 
+NaiveBayesClassifierKernel::
+att_prob_on_class(const ValueType& value, const size_t att_i, const size_t class_j) const
+{
+    if (dataset().get_att_desc(att_i).get_type() != ATT_TYPE_NUMERIC) {
+	return attDistrOnClass().prob(value, att_i, class_j);
+    }
+    return kernel(class_j, att_i).prob(value);
+}
+
+double 
+NaiveBayesClassifierKernel::
+att_log_prob_on_class(const ValueType& value, const size_t att_i, const size_t class_j) const
+{
+    if (dataset().get_att_desc(att_i).get_type() != ATT_TYPE_NUMERIC) {
+	return attDistrOnClass().log_prob(value, att_i, class_j);
+    }
+    return kernel(class_j, att_i).log_prob(value);
+}
+
+void 
+NaiveBayesClassifierKernel::
+bind_dataset(const Dataset& dataset)
+{
+    NaiveBayesClassifier::bind_dataset(dataset);
+    _kernel.clear();
+}
+
+Classifier*
+NaiveBayesClassifierKernel::
+clone(void) const
+{
+    NaiveBayesClassifierKernel* c = 
+	new NaiveBayesClassifierKernel(dataset(), class_index(), useAllAtt());
+    c->only_these_att() = only_these_att();
+    c->n_thread() = n_thread();
+    c->bandwidth() = bandwidth();
+    c->grid_size() = grid_size();
+    return c;
+}
+
+/** The numeric attributes c uses. */
+static vector<size_t>
+numeric_att_used(const Classifier& c)
+{
+    vector<size_t> att;
+    const size_t nAtt = c.dataset().num_of_att();
+    for (size_t i=0;i<nAtt;i++) {
+	if (i == c.class_index()) continue;
+	if (!c.useAllAtt() && find(c.only_these_att().begin(), 
+		    c.only_these_att().end(), i) == c.only_these_att().end()) continue;
+	if (c.dataset().get_att_desc(i).get_type() != ATT_TYPE_NUMERIC) continue;
+	att.push_back(i);
+    }
+    return att;
+}
+
+/** Everything the density estimating threads share. */
+struct KernelJobs {
+    const NaiveBayesClassifierKernel*	c;
+    /** The attributes, one per job. */
+    vector<size_t>		att;
+    /** The class of each row of the train set, -1 for the other rows 
+     * and those whose class is unknown. */
+    vector<int32_t>		rowClass;
+    /** The number of rows of each class in the train set. */
+    vector<size_t>		nRowOfClass;
+    /** Where the densities go. */
+    KernelDistribution*		kernel;
+};
+
+static void
+kernel_job(const size_t i, void* arg)
+{
+    const KernelJobs* jobs = (const KernelJobs*)arg;
+    const NaiveBayesClassifierKernel& kc = *jobs->c;
+    const size_t a = jobs->att[i];
+    const size_t nAtt = kc.dataset().num_of_att();
+    const size_t nClass = jobs->nRowOfClass.size();
+    const Column& att = kc.dataset().column(a);
+    const int32_t* cls = &jobs->rowClass[0];
+    const uint8_t* unknown = att.unknown().empty() ? NULL : &att.unknown()[0];
+    const NumericType* value = att.num().empty() ? NULL : &att.num()[0];
+
+    vector< vector<double> > values(nClass);
+    if (att.sparse()) {
+	vector<size_t> nStored(nClass, 0);
+	for (size_t k=0;k<att.row().size();k++) {
+	    const int32_t c = cls[att.row()[k]];
+	    if (c < 0) continue;
+	    nStored[c] ++;
+	    if (unknown[k]) continue;
+	    values[c].push_back(value[k]);
+	}
+	// The rest are 0.
+	for (size_t c=0;c<nClass;c++) {
+	    values[c].resize(values[c].size() + jobs->nRowOfClass[c] - nStored[c], 0);
+	}
+    } else {
+	const size_t nRow = jobs->rowClass.size();
+	for (size_t r=0;r<nRow;r++) {
+	    const int32_t c = cls[r];
+	    if (c < 0) continue;
+	    if (unknown[r]) continue;
+	    values[c].push_back(value[r]);
+	}
+    }
+    for (size_t c=0;c<nClass;c++) {
+	jobs->kernel[c*nAtt+a].fit(values[c], kc.bandwidth(), kc.grid_size());
+    }
+}
+
+void
+NaiveBayesClassifierKernel::
+train(void)
+{
+    NaiveBayesClassifier::train();
+    fprintf(stdout, "(I) NaiveBayesClassifierKernel: Estimating the kernel densities...\n");
+
+    const size_t nAtt = dataset().num_of_att();
+    const size_t nClass = get_class_desc().possible_value_vector().size();
+    _kernel.assign(nClass*nAtt, KernelDistribution());
+
+    KernelJobs jobs;
+    jobs.c = this;
+    jobs.att = numeric_att_used(*this);
+    jobs.rowClass.assign(dataset().num_of_inst(), -1);
+    jobs.nRowOfClass.assign(nClass, 0);
+    jobs.kernel = _kernel.empty() ? NULL : &_kernel[0];
+    const Column& klass = dataset().column(class_index());
+    for (size_t j=0;j<train_set().size();j++) {
+	const size_t r = train_set()[j];
+	const Attribute c = klass[r];
+	if (c.unknown) continue;
+	jobs.rowClass[r] = c.value.nom;
+	jobs.nRowOfClass[c.value.nom] ++;
+    }
+    if (jobs.rowClass.empty()) return;
+    run_parallel(kernel_job, &jobs, jobs.att.size(), n_thread());
+}
+
+void
+NaiveBayesClassifierKernel::
+train(InstanceStream& stream)
+{
+    fprintf(stdout, "(I) NaiveBayesClassifierKernel: Training the model on a stream...\n");
+    assert(stream.schema().num_of_att() == dataset().num_of_att());
+
+    const size_t nAtt = dataset().num_of_att();
+    const size_t nClass = get_class_desc().possible_value_vector().size();
+    const vector<size_t> att = numeric_att_used(*this);
+    // Element [c*att.size()+k]: the values of att[k] in class c.
+    vector< vector<double> > values(nClass*att.size());
+    NaiveBayesStatistics stat;
+    stat.init(dataset(), class_index());
+    Instance inst;
+    while (stream.next(inst)) {
+	stat.add(inst);
+	const Attribute& c = inst[class_index()];
+	if (c.unknown) continue;
+	for (size_t k=0;k<att.size();k++) {
+	    if (inst[att[k]].unknown) continue;
+	    values[c.value.nom*att.size()+k].push_back(inst[att[k]].value.num);
+	}
+    }
+    NaiveBayesClassifier::train(stat);
+
+    fprintf(stdout, "(I) NaiveBayesClassifierKernel: Estimating the kernel densities...\n");
+    _kernel.assign(nClass*nAtt, KernelDistribution());
+    for (size_t c=0;c<nClass;c++) {
+	for (size_t k=0;k<att.size();k++) {
+	    vector<double>& v = values[c*att.size()+k];
+	    _kernel[c*nAtt+att[k]].fit(v, bandwidth(), grid_size());
+	    vector<double>().swap(v);
+	}
+    }
+}
+
+double 
+NaiveBayesClassifierDiscrete::
+att_prob_on_class(const ValueType& value, const size_t att_i, const size_t class_j) const
+{
+    if (!discretizer().binned(att_i)) {
+	return attDistrOnClass().prob(value, att_i, class_j);
+    }
+    ValueType bin;
+    bin.nom = discretizer().bin(att_i, value.num);
+    return bin_pmf(class_j, att_i).prob(bin);
+}
+
+double 
+NaiveBayesClassifierDiscrete::
+att_log_prob_on_class(const ValueType& value, const size_t att_i, const size_t class_j) const
+{
+    if (!discretizer().binned(att_i)) {
+	return attDistrOnClass().log_prob(value, att_i, class_j);
+    }
+    ValueType bin;
+    bin.nom = discretizer().bin(att_i, value.num);
+    return bin_pmf(class_j, att_i).log_prob(bin);
+}
+
+void 
+NaiveBayesClassifierDiscrete::
+bind_dataset(const Dataset& dataset)
+{
+    NaiveBayesClassifier::bind_dataset(dataset);
+    _discretizer.clear();
+    _binPmf.clear();
+}
+
+Classifier*
+NaiveBayesClassifierDiscrete::
+clone(void) const
+{
+    NaiveBayesClassifierDiscrete* c = 
+	new NaiveBayesClassifierDiscrete(dataset(), class_index(), useAllAtt());
+    c->only_these_att() = only_these_att();
+    c->n_thread() = n_thread();
+    c->discretizer().method() = discretizer().method();
+    c->discretizer().n_bin() = discretizer().n_bin();
+    c->discretizer().n_candidate() = discretizer().n_candidate();
+    return c;
+}
+
+void
+NaiveBayesClassifierDiscrete::
+train(void)
+{
+    NaiveBayesClassifier::train();
+    const vector<size_t> att = numeric_att_used(*this);
+    _discretizer.fit(dataset(), train_set(), class_index(), att, n_thread());
+
+    // Count the bins of each class.
+    const size_t nAtt = dataset().num_of_att();
+    const size_t nClass = get_class_desc().possible_value_vector().size();
+    _binPmf.assign(nClass*nAtt, NominalDistribution());
+    vector< vector<size_t> > count(nClass);
+    const Column& klass = dataset().column(class_index());
+    for (size_t k=0;k<att.size();k++) {
+	const size_t a = att[k];
+	const Column& col = dataset().column(a);
+	for (size_t c=0;c<nClass;c++) {
+	    count[c].assign(discretizer().num_of_bin(a), 0);
+	}
+	for (size_t j=0;j<train_set().size();j++) {
+	    const size_t r = train_set()[j];
+	    const Attribute c = klass[r];
+	    if (c.unknown) continue;
+	    const Attribute v = col[r];
+	    if (v.unknown) continue;
+	    count[c.value.nom][discretizer().bin(a, v.value.num)] ++;
+	}
+	for (size_t c=0;c<nClass;c++) {
+	    _binPmf[c*nAtt+a].fit(count[c]);
+	}
+    }
+}
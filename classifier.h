@@ -9,6 +9,8 @@
 
 #include "common.h"
 #include "dataset.h"
+#include "parallel.h"
+#include "discretizer.h"
 
 /**
  * Confusion Matrix.
@@ -48,6 +50,18 @@ void show_conf(const Classifier& c,const vector< vector<double> >& conf);
 /** Print the trust values. */
 void show_trust(const Classifier& c,const vector<double>& trust);
 
+/**
+ * Find the class of the largest log likelihood.
+ *
+ * \param logL logL[c] is the log likelihood of class c, of nClass.
+ * \param posterior If not NULL, posterior[c] is set to the a posteriori 
+ *   probability of class c, normalized in log space; all 0 if every 
+ *   likelihood is 0.
+ * \return The class, 0 if every likelihood is 0.
+ */
+NominalType argmax_log_likelihood(const double* logL, const size_t nClass, 
+	double* posterior = NULL);
+
 /**
  * Basic classifier class.
  *
@@ -76,6 +90,8 @@ class Classifier {
 	vector<size_t>	_onlyTheseAtt;
 	/** If use all the att on classification, default yes */
 	bool		_useAllAtt;
+	/** Number of threads testing, default 0 (one per processor). */
+	size_t		_nThread;
 
     private:
 	/**
@@ -89,7 +105,7 @@ class Classifier {
 	 * other methods.
 	 */
 	virtual NominalType 
-	    classify_inst(const Instance& inst, double* maxProb=NULL) const = 0;
+	    classify_inst(const InstanceRef& inst, double* maxProb=NULL) const = 0;
 
     private:
 	/* =============== Performances ================== */
@@ -124,6 +140,11 @@ class Classifier {
 	size_t & class_index(void) {return _classIndex;}
 	const size_t & class_index(void) const {return _classIndex;}
 
+	/** Get/set the number of threads used by test(), 0 for one per 
+	 * processor. */
+	size_t& n_thread(void) {return _nThread;}
+	const size_t& n_thread(void) const {return _nThread;}
+
 	bool& useAllAtt(void) {return _useAllAtt;}
 	const bool& useAllAtt(void) const {return _useAllAtt;}
 	/** Get a reference to member _onlyTheseAtt.
@@ -163,8 +184,45 @@ class Classifier {
 	 */
 	virtual void train(void) = 0;
 
+	/**
+	 * Make a new classifier of the same kind and settings.
+	 *
+	 * It is bound to the same dataset, with the same class and 
+	 * attributes used, but is not trained, and its training / testing 
+	 * sets are the whole dataset. The caller deletes it.
+	 *
+	 * Used to work on the same dataset from several threads, each 
+	 * with a classifier of its own. \sa Xvalidator::xvalidate()
+	 */
+	virtual Classifier* clone(void) const = 0;
+
+	/**
+	 * Classify the n instances rows[0..n) of the dataset.
+	 *
+	 * By default it is classify_inst() on each, and the posterior of 
+	 * the class found is 1; an inherited class may do better.
+	 *
+	 * It only reads the classifier, so several threads can classify 
+	 * with the same one at the same time.
+	 *
+	 * \param label label[i] is set to the class of row rows[i].
+	 * \param posterior If not NULL, element [i*nClass+c] is set to the 
+	 *   a posteriori probability of class c of row rows[i], nClass being 
+	 *   the number of possible classes.
+	 */
+	virtual void classify_batch(const size_t* rows, const size_t n, 
+		NominalType* label, double* posterior = NULL) const;
+	/** Classify the n instances from row first on, as above. */
+	void classify_batch(const size_t first, const size_t n, 
+		NominalType* label, double* posterior = NULL) const;
+
 	/** 
 	 * Test on testing instances of _bindedDataset.
+	 *
+	 * The test set is cut in n_thread() parts, classified in parallel 
+	 * by classify_batch(), each into its own confusion matrix; they 
+	 * are added up in order, so the result does not depend on the 
+	 * number of threads.
 	 */
 	void test(void);
 
@@ -177,6 +235,7 @@ class Classifier {
 	    const bool useAllAtt = 1);
 	    //const RSeed seed = 0,
 	    //const double tt_ratio = 2.0 );
+	virtual ~Classifier() {}
 };
 
 /** 
@@ -187,33 +246,62 @@ class StatisticsClassifier : public Classifier {
 	/** The PMF of the class attribute random variable. */
 	vector<double>	_pClass; 
 
-	/**
-	 * Estimate the i-th class's probability.
-	 *
-	 * ONLY use training instances. This is used for obtaining 
-	 * class attribute PMF.
-	 */
-	double est_class_prob(const size_t i) const;
-
     public:
 	vector<double>& pClass(void) {return _pClass;}
 	const vector<double>& pClass(void) const {return _pClass;}
+	/**
+	 * Set _pClass from the number of training instances in each class.
+	 *
+	 * \param count count[i] is the num of training inst. of class i.
+	 * \param n The num of training inst., including those whose class 
+	 *   is unknown.
+	 */
+	void set_class_prob(const vector<size_t>& count, const size_t n);
+	/** Print _pClass. */
+	void show_class_prob(void) const;
+	/**
+	 * Bring the model up to date, if it is estimated lazily.
+	 *
+	 * Called before the model is used to classify. Nothing by default.
+	 *
+	 * \sa NaiveBayesClassifier::add_instance()
+	 */
+	virtual void refresh(void) const {}
 	/** Obtain prob of an instance given class index.
 	 *
 	 * This method has different implementation depending on which 
 	 * algorithm used, i.e., Naive Bayesian method with/without 
 	 * kernel estimatioin.
 	 */
-	virtual const double prob_inst_on_class( const Instance& inst, 
+	virtual const double prob_inst_on_class( const InstanceRef& inst, 
 		const NominalType c ) const =0;
+	/** Obtain the log of prob_inst_on_class().
+	 *
+	 * The product of the probabilities of many attributes underflows, 
+	 * and the classification is made on this instead. By default it 
+	 * is the log of prob_inst_on_class(), an inherited class should 
+	 * sum the logs of the attributes.
+	 */
+	virtual const double log_prob_inst_on_class( const InstanceRef& inst, 
+		const NominalType c ) const
+	{
+	    return log(prob_inst_on_class(inst, c));
+	}
 
 	StatisticsClassifier(const Dataset& ds,
 		const size_t ci, 
 		const bool useAllAtt=1) : Classifier(ds,ci,useAllAtt) {};
 
-	NominalType classify_inst(const Instance& inst, double* maxProb=NULL) const;
-	double a_posteriori(const NominalType c, const Instance& inst) const;
-	double likelihood(const NominalType c, const Instance& inst) const;
+	NominalType classify_inst(const InstanceRef& inst, double* maxProb=NULL) const;
+	double a_posteriori(const NominalType c, const InstanceRef& inst) const;
+	double likelihood(const NominalType c, const InstanceRef& inst) const;
+	/** The log of likelihood(), -HUGE_VAL if it is 0. */
+	double log_likelihood(const NominalType c, const InstanceRef& inst) const;
+	/** Classify with the log_likelihood() of each class, and give the 
+	 * a posteriori probabilities if asked. */
+	void classify_batch(const size_t* rows, const size_t n, 
+		NominalType* label, double* posterior = NULL) const;
+	using Classifier::classify_batch;
 	/** Train the model.
 	 *
 	 * In here it means to estimate the _pClass vector. */
@@ -230,9 +318,15 @@ class StatisticsClassifier : public Classifier {
  */
 class Distribution {
     public:
+	virtual ~Distribution() {}
 	virtual const double prob(ValueType value) const = 0;
+	/** The log of prob(), -HUGE_VAL for 0. */
+	virtual const double log_prob(ValueType value) const = 0;
 };
 
+class RunningMoments;
+class CompiledModel;
+
 /**
  * Normal Distribution describer.
  *
@@ -249,6 +343,10 @@ class NormalDistribution : public Distribution {
 	 * that when evaluating a probability from this distribution, 
 	 * 0 should be returned. */
 	bool _invalid;
+	/** log(1/sqrt(2*PI*var)), set by precompute(). */
+	double _logNorm;
+	/** 1/(2*var), set by precompute(). */
+	double _halfInvVar;
     public:
 	bool& invalid() {return _invalid;}
 	const bool& invalid() const {return _invalid;}
@@ -256,9 +354,23 @@ class NormalDistribution : public Distribution {
 	const NumericType& mean() const {return _mean;}
 	NumericType& var() {return _var;}
 	const NumericType& var() const {return _var;}
+	const double& log_norm() const {return _logNorm;}
+	const double& half_inv_var() const {return _halfInvVar;}
 	
 	const double prob(const ValueType value) const;
-	NormalDistribution() {invalid()=0;}
+	const double log_prob(const ValueType value) const;
+	/**
+	 * Estimate mean and (unbiased) variance from the moments of the 
+	 * values. Invalid if there is none.
+	 */
+	void fit(const RunningMoments& m);
+	/**
+	 * Precompute the constants used by log_prob() from the variance.
+	 *
+	 * fit() does it; call it after setting var() by hand.
+	 */
+	void precompute(void);
+	NormalDistribution() : _logNorm(0), _halfInvVar(0) {invalid()=0;}
 };
 
 /**
@@ -267,10 +379,132 @@ class NormalDistribution : public Distribution {
 class NominalDistribution : public Distribution {
     private:
 	vector<double> _pmf;
+	/** The log of _pmf, set by precompute(). */
+	vector<double> _logPmf;
     public:
 	vector<double>& pmf() {return _pmf;}
 	const vector<double>& pmf() const {return _pmf;}
+	const vector<double>& log_pmf() const {return _logPmf;}
 	const double prob(const ValueType value) const {return pmf().at(value.nom);}
+	const double log_prob(const ValueType value) const {return _logPmf.at(value.nom);}
+	/**
+	 * Precompute the log of the PMF used by log_prob().
+	 *
+	 * fit() does it; call it after setting pmf() by hand.
+	 */
+	void precompute(void);
+	/**
+	 * Estimate the PMF from the count of each possible value.
+	 *
+	 * Handles the zero possibility issue, see the implementation.
+	 */
+	void fit(const vector<size_t>& count);
+};
+
+/**
+ * Kernel density estimate of a numeric attribute.
+ *
+ * The density of n values is the mean of Gaussian kernels of width h 
+ * (the bandwidth) centred on them, cut off at CUTOFF bandwidths. 
+ * Evaluating it directly costs O(n); here it is tabulated once, by 
+ * fit(), where the values are: they are split into clusters, each value 
+ * within 2*CUTOFF bandwidths of the next, so that no kernel reaches 
+ * another cluster. A cluster of many values is tabulated on its own 
+ * grid of evenly spaced points: its values are linearly binned onto the 
+ * grid and the bins convolved with the kernel. A query interpolates the 
+ * log density between the two nearest points. A cluster of DIRECT 
+ * values or fewer, such as an outlier of a heavy tail, is summed 
+ * directly instead. Finding the cluster of a query costs O(log) of 
+ * their number.
+ *
+ * Out of the clusters, the density is the kernel of the nearest extreme 
+ * value alone, which is continuous with them. Within them and between 
+ * them, it is at least as much as the cut off kernel, so a gap between 
+ * the values does not make the probability 0.
+ *
+ * The bandwidth is the one of the rule: a long-tailed attribute keeps 
+ * the detail of its dense part, its grid following the values rather 
+ * than spanning their whole range.
+ */
+class KernelDistribution : public Distribution {
+    public:
+	/** The rules to choose the bandwidth from the values. */
+	enum Bandwidth {
+	    /** 0.9 * min(stddev, IQR/1.34) * n^(-1/5), or with stddev 
+	     * alone if the IQR is 0. */
+	    BANDWIDTH_SILVERMAN = 0,
+	    /** 1.06 * stddev * n^(-1/5). */
+	    BANDWIDTH_SCOTT,
+	    /** (max - min) / sqrt(n), as John and Langley (1995), and 
+	     * Weka's NaiveBayes -K used by Moore and Zuev. */
+	    BANDWIDTH_JOHN_LANGLEY
+	};
+	/** Where the kernels are cut off, in bandwidths. */
+	static const double CUTOFF;
+	/** The most values of a cluster summed directly, not tabulated. */
+	static const size_t DIRECT;
+
+    private:
+	/** A cluster of values and the kernels on either side. */
+	struct Cluster {
+	    /** Its first value less CUTOFF bandwidths, and its last 
+	     * value plus. */
+	    double	lo;
+	    double	hi;
+	    /** The inverse of the grid step, 0 if summed directly. */
+	    double	invStep;
+	    /** Its first grid point in _logDensity, or its first value 
+	     * in _value if summed directly, and how many. */
+	    size_t	first;
+	    size_t	n;
+	};
+	/** As NormalDistribution::_invalid: no value, probability 0. */
+	bool	_invalid;
+	/** All the values are the same, _min: scored as a 
+	 * NormalDistribution of variance 0. */
+	bool	_point;
+	/** The bandwidth, of the rule. */
+	double	_h;
+	/** The smallest and largest values. */
+	double	_min;
+	double	_max;
+	/** log(1/(n*h*sqrt(2*PI))), the log density at a value. */
+	double	_logPeak;
+	/** The clusters, in order of their values. */
+	vector<Cluster>	_cluster;
+	/** The grids of the clusters one after the other. Element [j]: 
+	 * log of the density at grid point j. */
+	vector<double>	_logDensity;
+	/** The values of the clusters summed directly. */
+	vector<double>	_value;
+
+	/** Tabulate the cluster c of the n sorted values v. */
+	void tabulate(const double* v, const size_t n, Cluster& c, 
+		const size_t gridSize);
+	/** c.lo > x, to find the cluster of x. */
+	static bool starts_after(const double x, const Cluster& c) {return c.lo > x;}
+    public:
+	const bool& invalid() const {return _invalid;}
+	const double& bandwidth() const {return _h;}
+	/** Number of points of the grids. */
+	size_t grid_size() const {return _logDensity.size();}
+	/** Number of clusters of the values. */
+	size_t num_of_cluster() const {return _cluster.size();}
+
+	const double prob(const ValueType value) const;
+	const double log_prob(const ValueType value) const;
+	/**
+	 * Estimate the density of values, which are sorted in place.
+	 *
+	 * \param rule How to choose the bandwidth.
+	 * \param gridSize The most grid points of a cluster. Fewer are 
+	 *   used if the bandwidth is wide enough for them, more if the 
+	 *   step would be more than half the bandwidth.
+	 */
+	void fit(vector<double>& values, const Bandwidth rule, 
+		const size_t gridSize);
+	KernelDistribution() : _invalid(1), _point(0), _h(0), _min(0), 
+	    _max(0), _logPeak(0) {}
 };
 
 /**
@@ -304,6 +538,7 @@ class AttDistrOnClass {
 	void init_table();
 
 	vector< vector<Distribution*> > & table() {return _table;}
+	const vector< vector<Distribution*> > & table() const {return _table;}
 	void bind_classifier(const Classifier& c) {_classifier = &c;}
 	const Classifier& classifier(void) {assert(_classifier);return *_classifier;}
 	const double prob(const ValueType& value, const size_t att_i, const size_t class_j) const
@@ -313,7 +548,125 @@ class AttDistrOnClass {
 	    assert(_table[class_j][att_i]);
 	    return _table[class_j][att_i]->prob(value);
 	}
+	const double log_prob(const ValueType& value, const size_t att_i, const size_t class_j) const
+	{
+	    assert(_classifier);
+	    assert(!_table.empty());
+	    assert(_table[class_j][att_i]);
+	    return _table[class_j][att_i]->log_prob(value);
+	}
+};
+class NaiveBayesClassifier;
+class InstanceStream;
+
+/**
+ * Running mean and variance of a sequence of values.
+ *
+ * Kept as the count, the mean and the sum of squared deviations from 
+ * the mean (M2), updated by Welford's method, which does not lose the 
+ * variance to cancellation as the sum of squares does. A value can be 
+ * removed again, and two sets of moments merged or one taken out of 
+ * the other (Chan et al.).
+ */
+class RunningMoments {
+    private:
+	size_t	_n;
+	double	_mean;
+	double	_m2;
+    public:
+	const size_t& n() const {return _n;}
+	const double& mean() const {return _mean;}
+	const double& m2() const {return _m2;}
+
+	void add(const double x)
+	{
+	    _n ++;
+	    const double d = x - _mean;
+	    _mean += d / _n;
+	    _m2 += d * (x - _mean);
+	}
+	/** Remove a value added before. */
+	void remove(const double x)
+	{
+	    assert(_n > 0);
+	    if (--_n == 0) {
+		_mean = _m2 = 0;
+		return;
+	    }
+	    const double d = x - _mean;
+	    _mean -= d / _n;
+	    _m2 -= d * (x - _mean);
+	    if (_m2 < 0) _m2 = 0;
+	}
+	/** Add n values, all 0, at once. */
+	void add_zeros(const size_t n)
+	{
+	    RunningMoments z;
+	    z._n = n;
+	    *this += z;
+	}
+	RunningMoments& operator+=(const RunningMoments& o);
+	/** Remove the values of o, all added before. */
+	RunningMoments& operator-=(const RunningMoments& o);
+	RunningMoments() : _n(0), _mean(0), _m2(0) {}
+};
+
+/**
+ * Sufficient statistics of a Naive Bayes model.
+ *
+ * The counts and sums a NaiveBayesClassifier is estimated from: the 
+ * num of instances of each class and, for each (class, attribute), 
+ * the count, sum and sum of squares of a numeric attribute or the 
+ * count of each value of a nominal one. Instances are added one at a 
+ * time, so a model can be trained without keeping them.
+ *
+ * They are additive: the statistics of two sets of instances is the 
+ * sum of theirs, and an instance or a subset can be removed again.
+ *
+ * \sa NaiveBayesClassifier::train(InstanceStream&), Xvalidator::xvalidate()
+ */
+class NaiveBayesStatistics {
+    private:
+	size_t		_nAtt;
+	size_t		_classIndex;
+	/** Instances added, including those whose class is unknown. */
+	size_t		_nInst;
+	/** Num of instances of each class. */
+	vector<size_t>	_nClass;
+	/** Element [c*_nAtt+a]: the known values of a numeric attribute a 
+	 * in class c. */
+	vector<RunningMoments>	_moments;
+	/** Element [c*_nAtt+a]: count of each value of a nominal attribute a in class c. */
+	vector< vector<size_t> > _hist;
+    public:
+	/** Clear and size the statistics for a schema. */
+	void init(const Dataset& schema, const size_t classIndex);
+	/** If init() has been called. */
+	bool initialized() const {return !_nClass.empty();}
+	/** Add an instance. */
+	void add(const InstanceRef& inst);
+	/** Remove an instance added before. */
+	void remove(const InstanceRef& inst);
+	/**
+	 * Add the instances of ds in rows.
+	 *
+	 * It goes column by column: each value is visited once, and for a 
+	 * sparse column only the stored values are, the rows of each class 
+	 * having the default value being counted in bulk. A row must not 
+	 * be in rows twice.
+	 */
+	void add(const Dataset& ds, const vector<size_t>& rows);
+	/** Add the statistics of other instances, of the same schema. */
+	NaiveBayesStatistics& operator+=(const NaiveBayesStatistics& o);
+	/** Remove the statistics of a subset of the instances. */
+	NaiveBayesStatistics& operator-=(const NaiveBayesStatistics& o);
+	/**
+	 * Estimate the model of c, i.e. its pClass() and attribute 
+	 * distributions, from the statistics.
+	 */
+	void estimate(NaiveBayesClassifier& c) const;
 };
+
 /**
  * Naive Bayesian method.
  */
@@ -330,6 +683,23 @@ class NaiveBayesClassifier : public StatisticsClassifier {
 	 */
 	AttDistrOnClass _attDistrOnClass;
 
+	/** The statistics the model is estimated from, kept for 
+	 * add_instance() and remove_instance(). */
+	NaiveBayesStatistics	_stat;
+	/** If _stat changed since the model was estimated. Read by 
+	 * refresh() without the lock, so it is loaded with acquire and 
+	 * cleared with release ordering (__atomic builtins). */
+	mutable bool		_stale;
+	/** Held while refresh() estimates the model. */
+	mutable Mutex		_refreshLock;
+	/** The model of classify_batch(), compiled on its first call, or 
+	 * NULL. Dropped when the model is trained or refreshed. */
+	mutable CompiledModel*	_compiled;
+	/** Held while classify_batch() compiles the model. */
+	mutable Mutex		_compileLock;
+	/** Delete _compiled. */
+	void drop_compiled(void) const;
+
 	/**
 	 * Get the conditional prob of i-th att value given j-th class.
 	 *
@@ -338,30 +708,101 @@ class NaiveBayesClassifier : public StatisticsClassifier {
 	 * trained.
 	 */
 	virtual double att_prob_on_class(const ValueType& value, const size_t att_i, const size_t class_j) const;
-
-	/**
-	 * Calculate a Distribution for RV att_i conditioned on class_j.
-	 *
-	 * This method is used to train the conditional probs.
-	 * The obtained distribution information will be directly stored 
-	 * to the attribute distribution table (attDistrOnClass()).
-	 */
-	virtual void calc_distr_for_att_on_class(size_t att_i, size_t class_j);
+	/** The log of att_prob_on_class(). */
+	virtual double att_log_prob_on_class(const ValueType& value, const size_t att_i, const size_t class_j) const;
 
     public:
 	virtual void bind_dataset(const Dataset& dataset);
 	AttDistrOnClass& attDistrOnClass(void) {return _attDistrOnClass;}
+	const AttDistrOnClass& attDistrOnClass(void) const {return _attDistrOnClass;}
 
 	/*
 	 * Train the model.
 	 *
-	 * Using train_class_prob() and train_att_prob_on_class() and put the 
-	 * corresponding values in _pClass and _attDistrOnClass.
+	 * Makes one pass over the train set to collect the statistics 
+	 * (NaiveBayesStatistics::add()), then estimates _pClass and 
+	 * _attDistrOnClass from them.
 	 *
 	 * Handles the issue in which the probability may be zero.
 	 */
 	virtual void train(void);
 
+	/**
+	 * Train the model on all the instances of a stream.
+	 *
+	 * The instances are not kept: each is added to the statistics 
+	 * (NaiveBayesStatistics) as it is read, so the memory used does not 
+	 * depend on the number of instances. The result is the same as 
+	 * train() with all of them in the train set.
+	 *
+	 * The stream's schema must be the same as dataset()'s. The bound 
+	 * dataset may have no instance.
+	 */
+	void train(InstanceStream& stream);
+
+	/** Train the model from statistics collected beforehand. */
+	void train(const NaiveBayesStatistics& stat);
+
+	/**
+	 * Add a labelled instance to the trained model.
+	 *
+	 * It updates the class count, and the nominal counts or the 
+	 * running mean and variance (RunningMoments) of the attributes, in 
+	 * O(attributes). The distributions are estimated again lazily, 
+	 * when the model is next used to classify (refresh()). The model 
+	 * is then the same as if trained with the instance, up to rounding.
+	 *
+	 * inst must be of the schema of dataset(), though not necessarily 
+	 * one of its rows. The model may be untrained, and only built by 
+	 * adding instances.
+	 *
+	 * Only for an additive() model: exits otherwise.
+	 *
+	 * Not thread safe: no other thread may use the classifier meanwhile.
+	 */
+	void add_instance(const InstanceRef& inst);
+	/**
+	 * Remove an instance the model was trained with, or added.
+	 *
+	 * \sa add_instance()
+	 */
+	void remove_instance(const InstanceRef& inst);
+	/** add_instance() on the rows of ds, of the schema of dataset(). */
+	void add_instances(const Dataset& ds, const vector<size_t>& rows);
+	/** remove_instance() on the rows of ds, of the schema of dataset(). */
+	void remove_instances(const Dataset& ds, const vector<size_t>& rows);
+
+	/**
+	 * Estimate the distributions again if instances were added or 
+	 * removed since. Several threads may classify at the same time: 
+	 * the first one does it.
+	 */
+	virtual void refresh(void) const;
+
+	/**
+	 * If the model is estimated from NaiveBayesStatistics alone.
+	 *
+	 * If so, train(const NaiveBayesStatistics&) gives the same model 
+	 * as train(), and the model on a train set can be put together from 
+	 * the statistics of its parts. An inherited class which needs 
+	 * more than that must return 0.
+	 */
+	virtual bool additive(void) const {return 1;}
+
+	virtual Classifier* clone(void) const;
+
+	/**
+	 * Classify the instances with a CompiledModel of this one, and its 
+	 * vector kernel. The predictions are the same as classify_inst()'s.
+	 *
+	 * The CompiledModel is kept for the next calls, until the model is 
+	 * trained or refresh()'ed again. Changing only_these_att() or the 
+	 * distributions otherwise needs a train().
+	 */
+	virtual void classify_batch(const size_t* rows, const size_t n, 
+		NominalType* label, double* posterior = NULL) const;
+	using Classifier::classify_batch;
+
 	/** Calculate prob of an instance given a class. 
 	 *
 	 * In NaiveBayesClassifier, this is done by assuming attributes are 
@@ -369,7 +810,11 @@ class NaiveBayesClassifier : public StatisticsClassifier {
 	 * distributed given a class label. 
 	 *
 	 * This may be changed by its inherited class, like Kernel. */
-	virtual const double prob_inst_on_class( const Instance& inst, 
+	virtual const double prob_inst_on_class( const InstanceRef& inst, 
+		const NominalType c ) const;
+	/** Calculate the log of prob_inst_on_class(), as a sum of the logs 
+	 * of the attribute probabilities, which does not underflow. */
+	virtual const double log_prob_inst_on_class( const InstanceRef& inst, 
 		const NominalType c ) const;
 
 	NaiveBayesClassifier(const Dataset& ds,
@@ -378,35 +823,142 @@ class NaiveBayesClassifier : public StatisticsClassifier {
 	{
 	    attDistrOnClass().bind_classifier(*this);
 	    attDistrOnClass().init_table();
+	    _stale = 0;
+	    _compiled = NULL;
 	}
+	virtual ~NaiveBayesClassifier() {drop_compiled();}
 };
 
 /** 
  * The class definition of the Naive Bayes Classifier with Kernel Estimation.
  *
- * The only difference to the naive Bayes classifier is the different implementation 
- * of prob_inst_on_class() method, which uses kernel estimation in estimating the 
- * conditional probability.
+ * The only difference to the naive Bayes classifier is that the 
+ * conditional probability of a numeric attribute is a kernel density 
+ * estimate (KernelDistribution) instead of a normal one, which fits 
+ * the skewed and heavy-tailed flow features much better. The nominal 
+ * attributes and the priors are estimated the same way.
  *
- * NOT IMPLEMENTED YET.
+ * The densities are tabulated at training time, so classifying costs 
+ * about as much as with NaiveBayesClassifier.
  */
 class NaiveBayesClassifierKernel : public NaiveBayesClassifier {
+    private:
+	KernelDistribution::Bandwidth	_bandwidth;
+	size_t				_gridSize;
+	/** Element [c*nAtt+a]: the density of the numeric attribute a 
+	 * given class c. */
+	vector<KernelDistribution>	_kernel;
+
+	virtual double att_prob_on_class(const ValueType& value, const size_t att_i, const size_t class_j) const;
+	virtual double att_log_prob_on_class(const ValueType& value, const size_t att_i, const size_t class_j) const;
+
     public:
-	/** Estimate the probability of a certain observation (instance) 
-	 * conditioned on a class label.
+	/** The rule to choose the bandwidth, BANDWIDTH_SILVERMAN by default. */
+	KernelDistribution::Bandwidth& bandwidth(void) {return _bandwidth;}
+	const KernelDistribution::Bandwidth& bandwidth(void) const {return _bandwidth;}
+	/** The most points of the density grid of each cluster of values, 
+	 * 512 by default. */
+	size_t& grid_size(void) {return _gridSize;}
+	const size_t& grid_size(void) const {return _gridSize;}
+	/** The density of the numeric attribute a given class c. */
+	const KernelDistribution& kernel(const NominalType c, const size_t a) const
+	{
+	    return _kernel.at(c*dataset().num_of_att()+a);
+	}
+
+	virtual void bind_dataset(const Dataset& dataset);
+
+	/**
+	 * Train the model.
 	 *
-	 * It's different from basic naive bayes in that it uses kernel 
-	 * estimation.
+	 * As NaiveBayesClassifier::train(), then the densities of the 
+	 * numeric attributes used are estimated, one attribute per job 
+	 * on n_thread() threads.
+	 */
+	virtual void train(void);
+	/**
+	 * Train the model on all the instances of a stream.
 	 *
-	 * NOT IMPLEMENTED YET.
+	 * Unlike NaiveBayesClassifier, the values of the numeric 
+	 * attributes used are kept until the densities are estimated.
 	 */
-	const double prob_inst_on_class( const Instance& inst, 
-		const NominalType c ) const
+	void train(InstanceStream& stream);
+
+	/** The densities need the values themselves. */
+	virtual bool additive(void) const {return 0;}
+
+	virtual Classifier* clone(void) const;
+
+	/** Not a NaiveBayesClassifier's model: one by one. */
+	void classify_batch(const size_t* rows, const size_t n, 
+		NominalType* label, double* posterior = NULL) const
+	{
+	    StatisticsClassifier::classify_batch(rows, n, label, posterior);
+	}
+	using Classifier::classify_batch;
+
+	NaiveBayesClassifierKernel(const Dataset& ds,
+		const size_t classIndex,
+		const bool useAllAtt=1) : NaiveBayesClassifier(ds,classIndex,useAllAtt)
+	{
+	    _bandwidth = KernelDistribution::BANDWIDTH_SILVERMAN;
+	    _gridSize = 512;
+	}
+};
+
+/**
+ * The Naive Bayes Classifier on discretized numeric attributes.
+ *
+ * The numeric attributes used are cut into intervals by a Discretizer
+ * learnt on the train set, and scored as nominal ones: the probability
+ * of the bin of a value, given the class, is looked up in a table
+ * estimated from the counts (NominalDistribution). It does not assume
+ * a shape of the distribution, which suits the multimodal packet size
+ * and inter-arrival features, and costs a few compares and a lookup.
+ *
+ * Its CompiledModel keeps the cut points, so it can be saved to a
+ * model file like the others.
+ */
+class NaiveBayesClassifierDiscrete : public NaiveBayesClassifier {
+    private:
+	Discretizer			_discretizer;
+	/** Element [c*nAtt+a]: the distribution of the bins of the 
+	 * numeric attribute a given class c. */
+	vector<NominalDistribution>	_binPmf;
+
+	virtual double att_prob_on_class(const ValueType& value, const size_t att_i, const size_t class_j) const;
+	virtual double att_log_prob_on_class(const ValueType& value, const size_t att_i, const size_t class_j) const;
+
+    public:
+	/** The settings, and after train() the cut points. */
+	Discretizer& discretizer(void) {return _discretizer;}
+	const Discretizer& discretizer(void) const {return _discretizer;}
+	/** The distribution of the bins of the numeric attribute a given 
+	 * class c. */
+	const NominalDistribution& bin_pmf(const NominalType c, const size_t a) const
 	{
-	    fprintf(stderr, "(E) Naive Bayes Classifier with Kernel Estimation "
-		    "is not yet implemented.\n");
-	    abort();
+	    return _binPmf.at(c*dataset().num_of_att()+a);
 	}
+
+	virtual void bind_dataset(const Dataset& dataset);
+
+	/**
+	 * Train the model.
+	 *
+	 * As NaiveBayesClassifier::train(), then the numeric attributes 
+	 * used are discretized on the train set and the bins counted. 
+	 * It takes two passes, so there is no training on a stream.
+	 */
+	virtual void train(void);
+
+	/** The cut points depend on the whole train set. */
+	virtual bool additive(void) const {return 0;}
+
+	virtual Classifier* clone(void) const;
+
+	NaiveBayesClassifierDiscrete(const Dataset& ds,
+		const size_t classIndex,
+		const bool useAllAtt=1) : NaiveBayesClassifier(ds,classIndex,useAllAtt) {}
 };
 
 #endif
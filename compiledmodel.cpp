@@ -0,0 +1,816 @@
+/**
+ * \file compiledmodel.cpp
+ * \author Kefei Lu
+ * \brief Implementation of CompiledModel.
+ * \sa compiledmodel.h
+ */
+
+#include "compiledmodel.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  #define __COMPILEDMODEL_X86__
+  #include <immintrin.h>
+#endif
+
+/**
+ * acc[i] += log_norm - (x[i]-mean)^2 * half_inv_var, for i in [0,n) 
+ * where known[i] is all ones; nothing where it is 0.
+ *
+ * Computed as in CompiledModel::log_likelihood(), without fused 
+ * multiply-add, so that every kernel gives the same result.
+ */
+typedef void (*GaussKernel)(double* acc, const double* x, 
+	const uint64_t* known, const size_t n, const double mean, 
+	const double halfInvVar, const double logNorm);
+
+static void
+gauss_scalar(double* acc, const double* x, const uint64_t* known, 
+	const size_t n, const double mean, const double halfInvVar, 
+	const double logNorm)
+{
+    for (size_t i=0;i<n;i++) {
+	if (!known[i]) continue;
+	const double d = x[i] - mean;
+	acc[i] += logNorm - d * d * halfInvVar;
+    }
+}
+
+#ifdef __COMPILEDMODEL_X86__
+__attribute__((target("sse2")))
+static void
+gauss_sse2(double* acc, const double* x, const uint64_t* known, 
+	const size_t n, const double mean, const double halfInvVar, 
+	const double logNorm)
+{
+    const __m128d m = _mm_set1_pd(mean);
+    const __m128d h = _mm_set1_pd(halfInvVar);
+    const __m128d l = _mm_set1_pd(logNorm);
+    size_t i = 0;
+    for (;i+2<=n;i+=2) {
+	const __m128d d = _mm_sub_pd(_mm_loadu_pd(x+i), m);
+	const __m128d t = _mm_sub_pd(l, _mm_mul_pd(_mm_mul_pd(d, d), h));
+	const __m128d k = _mm_loadu_pd((const double*)(known+i));
+	_mm_storeu_pd(acc+i, _mm_add_pd(_mm_loadu_pd(acc+i), _mm_and_pd(t, k)));
+    }
+    gauss_scalar(acc+i, x+i, known+i, n-i, mean, halfInvVar, logNorm);
+}
+
+__attribute__((target("avx2")))
+static void
+gauss_avx2(double* acc, const double* x, const uint64_t* known, 
+	const size_t n, const double mean, const double halfInvVar, 
+	const double logNorm)
+{
+    const __m256d m = _mm256_set1_pd(mean);
+    const __m256d h = _mm256_set1_pd(halfInvVar);
+    const __m256d l = _mm256_set1_pd(logNorm);
+    size_t i = 0;
+    for (;i+4<=n;i+=4) {
+	const __m256d d = _mm256_sub_pd(_mm256_loadu_pd(x+i), m);
+	const __m256d t = _mm256_sub_pd(l, _mm256_mul_pd(_mm256_mul_pd(d, d), h));
+	const __m256d k = _mm256_loadu_pd((const double*)(known+i));
+	_mm256_storeu_pd(acc+i, 
+		_mm256_add_pd(_mm256_loadu_pd(acc+i), _mm256_and_pd(t, k)));
+    }
+    gauss_scalar(acc+i, x+i, known+i, n-i, mean, halfInvVar, logNorm);
+}
+#endif
+
+/** The best level the processor supports. */
+static CompiledModel::SimdLevel
+best_simd_level()
+{
+#ifdef __COMPILEDMODEL_X86__
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return CompiledModel::SIMD_AVX2;
+    if (__builtin_cpu_supports("sse2")) return CompiledModel::SIMD_SSE2;
+#endif
+    return CompiledModel::SIMD_SCALAR;
+}
+
+static GaussKernel
+gauss_kernel(const CompiledModel::SimdLevel level)
+{
+#ifdef __COMPILEDMODEL_X86__
+    if (level == CompiledModel::SIMD_AVX2) return gauss_avx2;
+    if (level == CompiledModel::SIMD_SSE2) return gauss_sse2;
+#endif
+    return gauss_scalar;
+}
+
+const size_t CompiledModel::BATCH;
+
+static CompiledModel::SimdLevel simdLevel = best_simd_level();
+static GaussKernel gaussKernel = gauss_kernel(simdLevel);
+
+CompiledModel::SimdLevel
+CompiledModel::
+simd_level()
+{
+    return simdLevel;
+}
+
+CompiledModel::SimdLevel
+CompiledModel::
+set_simd_level(SimdLevel level)
+{
+    const SimdLevel best = best_simd_level();
+    if (level > best) level = best;
+    simdLevel = level;
+    gaussKernel = gauss_kernel(level);
+    return level;
+}
+
+const char*
+CompiledModel::
+simd_name(const SimdLevel level)
+{
+    switch (level) {
+	case SIMD_AVX2: return "avx2";
+	case SIMD_SSE2: return "sse2";
+	default: return "scalar";
+    }
+}
+
+#define MODEL_MAGIC "NB4ITMD"
+#define MODEL_VERSION 2
+#define MODEL_BYTE_ORDER 0x01020304u
+
+/** Header of a model file. The schema and the block follow, 8 byte 
+ * aligned. */
+struct ModelHeader {
+    char	magic[8];
+    uint32_t	version;
+    uint32_t	byteOrder; ///< MODEL_BYTE_ORDER as written.
+    uint64_t	nSchemaAtt; ///< Number of attributes in the schema.
+    uint64_t	nClass;
+    uint64_t	classIndex;
+    uint64_t	nAtt; ///< Number of attributes used.
+    uint64_t	useAllAtt;
+    uint64_t	nPmf;
+    uint64_t	nCut;
+    uint64_t	blockSize;
+};
+
+/**
+ * Take an array of n T's at offset off of base, and move off on, 8 byte 
+ * aligned. NULL if base is NULL, to only count the size.
+ */
+template <class T>
+static const T*
+take_array(const char* base, size_t& off, const size_t n)
+{
+    const T* a = base ? (const T*)(base + off) : NULL;
+    off += (n*sizeof(T) + 7) / 8 * 8;
+    return a;
+}
+
+size_t
+CompiledModel::
+layout(const char* base)
+{
+    size_t off = 0;
+    const size_t nCell = _nClass*_nAtt;
+    _att = take_array<uint64_t>(base, off, _nAtt);
+    _numeric = take_array<uint8_t>(base, off, _nAtt);
+    _binned = take_array<uint8_t>(base, off, _nAtt);
+    _pClass = take_array<double>(base, off, _nClass);
+    _logPrior = take_array<double>(base, off, _nClass);
+    _mean = take_array<double>(base, off, nCell);
+    _var = take_array<double>(base, off, nCell);
+    _halfInvVar = take_array<double>(base, off, nCell);
+    _logNorm = take_array<double>(base, off, nCell);
+    _kind = take_array<uint8_t>(base, off, nCell);
+    _pmfOffset = take_array<uint64_t>(base, off, _nAtt);
+    _nValue = take_array<uint64_t>(base, off, _nAtt);
+    _pmf = take_array<double>(base, off, _nPmf);
+    _logPmf = take_array<double>(base, off, _nPmf);
+    _cutOffset = take_array<uint64_t>(base, off, _nAtt);
+    _cut = take_array<double>(base, off, _nCut);
+    return off;
+}
+
+CompiledModel::
+CompiledModel(const NaiveBayesClassifier& c)
+{
+    if (dynamic_cast<const NaiveBayesClassifierKernel*>(&c)) {
+	fprintf(stderr, "(E) CompiledModel: The kernel densities of a "
+		"NaiveBayesClassifierKernel cannot be compiled.\n");
+	exit(1);
+    }
+    c.refresh();
+    assert(!c.pClass().empty());
+    const NaiveBayesClassifierDiscrete* dc = 
+	dynamic_cast<const NaiveBayesClassifierDiscrete*>(&c);
+    const Dataset& ds = c.dataset();
+    _schema = &ds;
+    _nClass = c.pClass().size();
+    _classIndex = c.class_index();
+    _useAllAtt = c.useAllAtt();
+
+    // The attributes used, as in NaiveBayesClassifier::log_prob_inst_on_class()
+    vector<size_t> att;
+    if (c.useAllAtt()) {
+	for (size_t a=0;a<ds.num_of_att();a++) {
+	    if (a != _classIndex) att.push_back(a);
+	}
+    } else {
+	for (size_t i=0;i<c.only_these_att().size();i++) {
+	    const size_t a = c.only_these_att()[i];
+	    if (a != _classIndex) att.push_back(a);
+	}
+    }
+    _nAtt = att.size();
+    _nPmf = 0;
+    _nCut = 0;
+    for (size_t k=0;k<_nAtt;k++) {
+	const AttDesc& desc = ds.get_att_desc(att[k]);
+	if (dc && dc->discretizer().binned(att[k])) {
+	    _nPmf += _nClass * dc->discretizer().num_of_bin(att[k]);
+	    _nCut += dc->discretizer().cut(att[k]).size();
+	    continue;
+	}
+	if (desc.get_type() == ATT_TYPE_NUMERIC) continue;
+	_nPmf += _nClass * desc.possible_value_vector().size();
+    }
+
+    // Size the block, then fill it in.
+    _blockSize = layout(NULL);
+    _own.assign(_blockSize / sizeof(uint64_t), 0);
+    _block = (const char*)&_own[0];
+    layout(_block);
+    uint64_t* attA = (uint64_t*)_att;
+    uint8_t* numeric = (uint8_t*)_numeric;
+    uint8_t* binned = (uint8_t*)_binned;
+    double* pClass = (double*)_pClass;
+    double* logPrior = (double*)_logPrior;
+    double* mean = (double*)_mean;
+    double* var = (double*)_var;
+    double* halfInvVar = (double*)_halfInvVar;
+    double* logNorm = (double*)_logNorm;
+    uint8_t* kind = (uint8_t*)_kind;
+    uint64_t* pmfOffset = (uint64_t*)_pmfOffset;
+    uint64_t* nValue = (uint64_t*)_nValue;
+    double* pmf = (double*)_pmf;
+    double* logPmf = (double*)_logPmf;
+    uint64_t* cutOffset = (uint64_t*)_cutOffset;
+    double* cut = (double*)_cut;
+
+    for (size_t j=0;j<_nClass;j++) {
+	const double p = c.pClass()[j];
+	pClass[j] = p;
+	logPrior[j] = p == 0 ? -HUGE_VAL : log(p);
+    }
+
+    const vector< vector<Distribution*> >& table = c.attDistrOnClass().table();
+    size_t offset = 0;
+    size_t nCut = 0;
+    for (size_t k=0;k<_nAtt;k++) {
+	const size_t a = att[k];
+	attA[k] = a;
+	numeric[k] = ds.get_att_desc(a).get_type() == ATT_TYPE_NUMERIC;
+	binned[k] = dc && dc->discretizer().binned(a);
+	if (binned[k]) {
+	    const vector<double>& cuts = dc->discretizer().cut(a);
+	    cutOffset[k] = nCut;
+	    copy(cuts.begin(), cuts.end(), cut + nCut);
+	    nCut += cuts.size();
+	    nValue[k] = cuts.size() + 1;
+	    pmfOffset[k] = offset;
+	    for (size_t j=0;j<_nClass;j++) {
+		kind[j*_nAtt+k] = GAUSS_INVALID;
+		const NominalDistribution& d = dc->bin_pmf(j, a);
+		assert(d.log_pmf().size() == nValue[k]);
+		copy(d.pmf().begin(), d.pmf().end(), pmf + offset);
+		copy(d.log_pmf().begin(), d.log_pmf().end(), logPmf + offset);
+		offset += nValue[k];
+	    }
+	} else if (numeric[k]) {
+	    for (size_t j=0;j<_nClass;j++) {
+		const NormalDistribution* d =
+		    static_cast<const NormalDistribution*>(table[j][a]);
+		const size_t i = j*_nAtt+k;
+		mean[i] = d->mean();
+		var[i] = d->var();
+		halfInvVar[i] = d->half_inv_var();
+		logNorm[i] = d->log_norm();
+		if (d->invalid()) {
+		    kind[i] = GAUSS_INVALID;
+		} else if (fabs(d->var()) <= DBL_MIN) {
+		    kind[i] = GAUSS_POINT;
+		} else {
+		    kind[i] = GAUSS_NORMAL;
+		}
+	    }
+	} else {
+	    for (size_t j=0;j<_nClass;j++) {
+		kind[j*_nAtt+k] = GAUSS_INVALID;
+	    }
+	    nValue[k] = ds.get_att_desc(a).possible_value_vector().size();
+	    pmfOffset[k] = offset;
+	    for (size_t j=0;j<_nClass;j++) {
+		const NominalDistribution* d =
+		    static_cast<const NominalDistribution*>(table[j][a]);
+		assert(d->log_pmf().size() == nValue[k]);
+		copy(d->pmf().begin(), d->pmf().end(), pmf + offset);
+		copy(d->log_pmf().begin(), d->log_pmf().end(), logPmf + offset);
+		offset += nValue[k];
+	    }
+	}
+    }
+}
+
+CompiledModel::
+CompiledModel(const char* model_file)
+{
+    fprintf( stdout, "(I) Opening model file: %s...\n", model_file );
+    if (_file.open(model_file) != 0) {
+	fprintf(stderr, "(E) Opening file %s failed.\n", model_file);
+	exit(1);
+    }
+    ModelHeader h;
+    memset(&h, 0, sizeof(h));
+    if (_file.size() >= sizeof(h)) memcpy(&h, _file.data(), sizeof(h));
+    if (memcmp(h.magic, MODEL_MAGIC, sizeof(MODEL_MAGIC)) != 0
+	    || h.version != MODEL_VERSION
+	    || h.byteOrder != MODEL_BYTE_ORDER) {
+	fprintf(stderr, "(E) %s is not a model file "
+		"of this version and byte order.\n", model_file);
+	exit(1);
+    }
+    size_t pos = sizeof(h);
+    pos += _ownSchema.open_schema(_file.data() + pos, _file.size() - pos, 
+	    h.nSchemaAtt, model_file);
+    _schema = &_ownSchema;
+
+    _nClass = h.nClass;
+    _classIndex = h.classIndex;
+    _nAtt = h.nAtt;
+    _useAllAtt = h.useAllAtt;
+    _nPmf = h.nPmf;
+    _nCut = h.nCut;
+    // Each element takes a byte at least: larger counts would overflow 
+    // the layout.
+    const size_t room = _file.size() - pos;
+    if (_nClass == 0 || _nClass > room || _nAtt > room / _nClass
+	    || _nPmf > room || _nCut > room) {
+	fprintf(stderr, "(E) File %s is truncated or corrupted.\n", model_file);
+	exit(1);
+    }
+    _blockSize = layout(NULL);
+    if (_blockSize != h.blockSize || room < _blockSize
+	    || _classIndex >= _schema->num_of_att()) {
+	fprintf(stderr, "(E) File %s is truncated or corrupted.\n", model_file);
+	exit(1);
+    }
+    _block = _file.data() + pos;
+    layout(_block);
+    // Every index the scoring takes from the arrays must be in range.
+    for (size_t k=0;k<_nAtt;k++) {
+	bool bad = _att[k] >= _schema->num_of_att() || _att[k] == _classIndex;
+	if (!bad) {
+	    const AttDesc& desc = _schema->get_att_desc(_att[k]);
+	    bad = (bool)_numeric[k] != (desc.get_type() == ATT_TYPE_NUMERIC)
+		|| (_binned[k] && !_numeric[k]);
+	    if (!_numeric[k]) {
+		bad = bad || _nValue[k] != desc.possible_value_vector().size();
+	    }
+	}
+	if (!bad && (_binned[k] || !_numeric[k])) {
+	    bad = _nValue[k] == 0 || _pmfOffset[k] > _nPmf
+		|| _nValue[k] > (_nPmf - _pmfOffset[k]) / _nClass;
+	}
+	if (!bad && _binned[k]) {
+	    bad = _cutOffset[k] > _nCut || _nValue[k]-1 > _nCut - _cutOffset[k];
+	}
+	for (size_t c=0;!bad && c<_nClass;c++) {
+	    bad = _kind[c*_nAtt+k] > GAUSS_INVALID;
+	}
+	if (bad) {
+	    fprintf(stderr, "(E) File %s is corrupted.\n", model_file);
+	    exit(1);
+	}
+    }
+    fprintf( stdout, "(I) Read a model of %d classes on %d attributes.\n", 
+	    (int)_nClass, (int)_nAtt );
+}
+
+/** Write n bytes, exit on failure. */
+static void
+model_write(FILE* fp, const void* p, const size_t n, const char* file)
+{
+    if (n && fwrite(p, 1, n, fp) != n) {
+	fprintf(stderr, "(E) Writing file %s failed.\n", file);
+	exit(1);
+    }
+}
+
+void
+CompiledModel::
+save(const char* model_file) const
+{
+    FILE* fp = fopen(model_file, "wb");
+    if (!fp) {
+	fprintf(stderr, "(E) Opening file %s failed.\n", model_file);
+	exit(1);
+    }
+    ModelHeader h;
+    memset(&h, 0, sizeof(h));
+    strcpy(h.magic, MODEL_MAGIC);
+    h.version = MODEL_VERSION;
+    h.byteOrder = MODEL_BYTE_ORDER;
+    h.nSchemaAtt = schema().num_of_att();
+    h.nClass = _nClass;
+    h.classIndex = _classIndex;
+    h.nAtt = _nAtt;
+    h.useAllAtt = _useAllAtt;
+    h.nPmf = _nPmf;
+    h.nCut = _nCut;
+    h.blockSize = _blockSize;
+    model_write(fp, &h, sizeof(h), model_file);
+    schema().save_schema(fp, model_file);
+    model_write(fp, _block, _blockSize, model_file);
+    // save_schema() leaves its errors to ferror().
+    const bool failed = ferror(fp);
+    if (fclose(fp) != 0 || failed) {
+	fprintf(stderr, "(E) Writing file %s failed.\n", model_file);
+	exit(1);
+    }
+}
+
+/** Print a double as a C++ literal which reads back the same, NaN 
+ * included: a Gaussian of one training value has a NaN variance. */
+static void
+print_double(FILE* fp, const double v)
+{
+    if (v != v) fprintf(fp, "NAN");
+    else if (v == HUGE_VAL) fprintf(fp, "HUGE_VAL");
+    else if (v == -HUGE_VAL) fprintf(fp, "-HUGE_VAL");
+    else fprintf(fp, "%.17g", v);
+}
+
+/** Print a named array of n doubles. */
+static void
+print_array(FILE* fp, const char* name, const size_t k, const double* v, 
+	const size_t n)
+{
+    fprintf(fp, "static NB4IT_CONST double %s_%d[%d] = {", name, (int)k, (int)n);
+    for (size_t i=0;i<n;i++) {
+	fprintf(fp, i ? ", " : "");
+	print_double(fp, v[i]);
+    }
+    fprintf(fp, "};\n");
+}
+
+/** Print a string as a C++ literal. */
+static void
+print_string(FILE* fp, const char* str)
+{
+    fputc('"', fp);
+    for (;*str;str++) {
+	if (*str == '"' || *str == '\\') fputc('\\', fp);
+	fputc(*str, fp);
+    }
+    fputc('"', fp);
+}
+
+/** Print a name in a comment, which it must not close. */
+static void
+print_comment(FILE* fp, const char* str)
+{
+    for (;*str;str++) {
+	fputc(*str, fp);
+	if (str[0] == '*' && str[1] == '/') fputc(' ', fp);
+    }
+}
+
+void
+CompiledModel::
+save_header(const char* header_file, const char* name) const
+{
+    FILE* fp = fopen(header_file, "w");
+    if (!fp) {
+	fprintf(stderr, "(E) Opening file %s failed.\n", header_file);
+	exit(1);
+    }
+    const size_t nClass = _nClass;
+    const AttDesc& klass = schema().get_att_desc(_classIndex);
+
+    fprintf(fp, "/*\n"
+	    " * A Naive Bayes model of %d classes on %d attributes, generated by \n"
+	    " * CompiledModel::save_header(). Do not edit.\n"
+	    " *\n"
+	    " * x[k] is the value of attribute ATT[k] of the schema: the number, or \n"
+	    " * the index of the nominal value; NaN if unknown.\n"
+	    " */\n\n", (int)nClass, (int)_nAtt);
+    fprintf(fp, "#ifndef __NB4IT_MODEL_%s__\n#define __NB4IT_MODEL_%s__\n\n", 
+	    name, name);
+    fprintf(fp, "#include <math.h>\n#include <float.h>\n\n");
+    fprintf(fp, "#ifndef NB4IT_CONST\n"
+	    "#if __cplusplus >= 201103L\n"
+	    "  #define NB4IT_CONST constexpr\n"
+	    "#else\n"
+	    "  #define NB4IT_CONST const\n"
+	    "#endif\n"
+	    "#endif\n\n");
+    fprintf(fp, "namespace %s {\n\n", name);
+    fprintf(fp, "enum {\n    N_CLASS = %d,\n    N_ATT = %d,\n"
+	    "    N_SCHEMA_ATT = %d,\n    CLASS_INDEX = %d\n};\n\n", 
+	    (int)nClass, (int)_nAtt, (int)schema().num_of_att(), 
+	    (int)_classIndex);
+
+    fprintf(fp, "/** The attributes used, in the order of x. */\n");
+    fprintf(fp, "static NB4IT_CONST unsigned ATT[%d] = {", (int)max(_nAtt, (size_t)1));
+    for (size_t k=0;k<_nAtt;k++) {
+	fprintf(fp, "%s%d", k ? ", " : "", (int)_att[k]);
+    }
+    fprintf(fp, "};\n");
+    fprintf(fp, "static const char* const ATT_NAME[%d] = {", (int)max(_nAtt, (size_t)1));
+    for (size_t k=0;k<_nAtt;k++) {
+	fprintf(fp, k ? ", " : "");
+	print_string(fp, schema().get_att_desc(_att[k]).get_name());
+    }
+    fprintf(fp, "};\n");
+    fprintf(fp, "static const char* const CLASS_NAME[%d] = {", (int)nClass);
+    for (size_t j=0;j<nClass;j++) {
+	fprintf(fp, j ? ", " : "");
+	print_string(fp, klass.map(j).c_str());
+    }
+    fprintf(fp, "};\n");
+    fprintf(fp, "static NB4IT_CONST double LOG_PRIOR[%d] = {", (int)nClass);
+    for (size_t j=0;j<nClass;j++) {
+	fprintf(fp, j ? ", " : "");
+	print_double(fp, _logPrior[j]);
+    }
+    fprintf(fp, "};\n\n");
+
+    // The constants of each attribute.
+    vector<double> v(nClass);
+    for (size_t k=0;k<_nAtt;k++) {
+	fprintf(fp, "/* x[%d]: ", (int)k);
+	print_comment(fp, schema().get_att_desc(_att[k]).get_name());
+	fprintf(fp, " */\n");
+	if (_numeric[k] && !_binned[k]) {
+	    for (size_t j=0;j<nClass;j++) v[j] = _mean[j*_nAtt+k];
+	    print_array(fp, "MEAN", k, &v[0], nClass);
+	    for (size_t j=0;j<nClass;j++) v[j] = _halfInvVar[j*_nAtt+k];
+	    print_array(fp, "HALF_INV_VAR", k, &v[0], nClass);
+	    for (size_t j=0;j<nClass;j++) v[j] = _logNorm[j*_nAtt+k];
+	    print_array(fp, "LOG_NORM", k, &v[0], nClass);
+	    continue;
+	}
+	if (_binned[k] && _nValue[k] > 1) {
+	    print_array(fp, "CUT", k, _cut + _cutOffset[k], _nValue[k]-1);
+	}
+	fprintf(fp, "static NB4IT_CONST double LOG_PMF_%d[%d][%d] = {\n", 
+		(int)k, (int)nClass, (int)_nValue[k]);
+	for (size_t j=0;j<nClass;j++) {
+	    fprintf(fp, "    {");
+	    for (size_t i=0;i<_nValue[k];i++) {
+		fprintf(fp, i ? ", " : "");
+		print_double(fp, log_pmf(j, k, i));
+	    }
+	    fprintf(fp, "}%s\n", j+1 < nClass ? "," : "");
+	}
+	fprintf(fp, "};\n");
+    }
+
+    // The scorer: the terms are summed in the order of log_likelihood().
+    fprintf(fp, "\n/** logL[c]: the log of the prior times the probability of x "
+	    "given class c. */\n");
+    fprintf(fp, "static inline void\nlog_likelihood(const double* x, double* logL)\n{\n");
+    fprintf(fp, "    double s[N_CLASS];\n");
+    fprintf(fp, "    for (int c = 0; c < N_CLASS; c++) s[c] = 0;\n");
+    for (size_t k=0;k<_nAtt;k++) {
+	fprintf(fp, "    if (x[%d] == x[%d]) {\n", (int)k, (int)k);
+	// A binned attribute of one bin needs no value.
+	if (!_binned[k] || _nValue[k] > 1) {
+	    fprintf(fp, "\tconst double v = x[%d];\n", (int)k);
+	}
+	if (_numeric[k] && !_binned[k]) {
+	    bool normal = 1;
+	    for (size_t j=0;j<nClass;j++) {
+		if (_kind[j*_nAtt+k] != GAUSS_NORMAL) normal = 0;
+	    }
+	    if (normal) {
+		fprintf(fp, "\tfor (int c = 0; c < N_CLASS; c++) {\n"
+			"\t    const double d = v - MEAN_%d[c];\n"
+			"\t    s[c] += LOG_NORM_%d[c] - d * d * HALF_INV_VAR_%d[c];\n"
+			"\t}\n", (int)k, (int)k, (int)k);
+	    } else {
+		for (size_t j=0;j<nClass;j++) {
+		    switch (_kind[j*_nAtt+k]) {
+			case GAUSS_NORMAL:
+			    fprintf(fp, "\t{ const double d = v - MEAN_%d[%d]; "
+				    "s[%d] += LOG_NORM_%d[%d] - d * d * HALF_INV_VAR_%d[%d]; }\n",
+				    (int)k, (int)j, (int)j, (int)k, (int)j, (int)k, (int)j);
+			    break;
+			case GAUSS_POINT:
+			    fprintf(fp, "\ts[%d] += fabs(v - MEAN_%d[%d]) <= DBL_MIN ? ", 
+				    (int)j, (int)k, (int)j);
+			    print_double(fp, log(1-DBL_MIN));
+			    fprintf(fp, " : ");
+			    print_double(fp, log(DBL_MIN));
+			    fprintf(fp, ";\n");
+			    break;
+			default:
+			    fprintf(fp, "\ts[%d] += -HUGE_VAL;\n", (int)j);
+		    }
+		}
+	    }
+	} else {
+	    if (_binned[k]) {
+		fprintf(fp, "\tconst unsigned i = 0");
+		for (size_t i=0;i+1<_nValue[k];i++) {
+		    fprintf(fp, "\n\t    + (v > CUT_%d[%d])", (int)k, (int)i);
+		}
+		fprintf(fp, ";\n");
+	    } else {
+		fprintf(fp, "\tconst unsigned i = (unsigned)v;\n");
+	    }
+	    fprintf(fp, "\tfor (int c = 0; c < N_CLASS; c++) s[c] += LOG_PMF_%d[c][i];\n", 
+		    (int)k);
+	}
+	fprintf(fp, "    }\n");
+    }
+    fprintf(fp, "    for (int c = 0; c < N_CLASS; c++) {\n"
+	    "\tlogL[c] = LOG_PRIOR[c] == -HUGE_VAL ? -HUGE_VAL : s[c] + LOG_PRIOR[c];\n"
+	    "    }\n}\n\n");
+
+    fprintf(fp, "/** The class of the largest log_likelihood(), the first one on "
+	    "a tie. */\n");
+    fprintf(fp, "static inline unsigned\nclassify(const double* x)\n{\n"
+	    "    double logL[N_CLASS];\n"
+	    "    log_likelihood(x, logL);\n"
+	    "    unsigned best = 0;\n"
+	    "    double max = -HUGE_VAL;\n"
+	    "    for (int c = 0; c < N_CLASS; c++) {\n"
+	    "\tif (logL[c] > max) {\n"
+	    "\t    max = logL[c];\n"
+	    "\t    best = c;\n"
+	    "\t}\n"
+	    "    }\n"
+	    "    return best;\n}\n\n");
+    fprintf(fp, "} // namespace %s\n\n#endif\n", name);
+
+    if (fclose(fp) != 0) {
+	fprintf(stderr, "(E) Writing file %s failed.\n", header_file);
+	exit(1);
+    }
+}
+
+double
+CompiledModel::
+log_likelihood(const NominalType c, const InstanceRef& inst) const
+{
+    if (_logPrior[c] == -HUGE_VAL) return -HUGE_VAL;
+    const size_t nAtt = _nAtt;
+    const size_t base = c*nAtt;
+    double sum = 0;
+    for (size_t k=0;k<nAtt;k++) {
+	const Attribute att = inst[_att[k]];
+	if (att.unknown) continue;
+	if (_binned[k]) {
+	    sum += _logPmf[_pmfOffset[k] + c*_nValue[k] + bin(k, att.value.num)];
+	} else if (_numeric[k]) {
+	    const size_t i = base+k;
+	    const double d = att.value.num - _mean[i];
+	    switch (_kind[i]) {
+		case GAUSS_NORMAL:
+		    sum += _logNorm[i] - d * d * _halfInvVar[i];
+		    break;
+		case GAUSS_POINT:
+		    // As NormalDistribution::log_prob()
+		    sum += fabs(d) <= DBL_MIN ? log(1-DBL_MIN) : log(DBL_MIN);
+		    break;
+		default:
+		    sum += -HUGE_VAL;
+	    }
+	} else {
+	    sum += _logPmf[_pmfOffset[k] + c*_nValue[k] + att.value.nom];
+	}
+    }
+    return sum + _logPrior[c];
+}
+
+NominalType
+CompiledModel::
+classify(const InstanceRef& inst) const
+{
+    size_t curMaxClassIndex = 0;
+    double curMax = -HUGE_VAL;
+    for (size_t j=0;j<_nClass;j++) {
+	const double tmp = log_likelihood(j, inst);
+	if (tmp > curMax) {
+	    curMax = tmp;
+	    curMaxClassIndex = j;
+	}
+    }
+    return curMaxClassIndex;
+}
+
+void
+CompiledModel::
+score_batch(const Dataset& ds, const size_t* rows, const size_t n, 
+	double* logL, Scratch& scratch) const
+{
+    const size_t nAtt = _nAtt;
+    // acc[c*BATCH+i]: the sum of the terms of class c of the i-th row 
+    // of the batch. resize() keeps the capacity, so only the first call 
+    // allocates.
+    vector<double>& acc = scratch.acc;
+    vector<double>& x = scratch.x;
+    vector<uint64_t>& known = scratch.known;
+    vector<NominalCode>& nom = scratch.nom;
+    acc.resize(_nClass*BATCH);
+    x.resize(BATCH);
+    known.resize(BATCH);
+    nom.resize(BATCH);
+    for (size_t start=0;start<n;start+=BATCH) {
+	const size_t m = min(BATCH, n-start);
+	const size_t* r = rows + start;
+	acc.assign(acc.size(), 0.0);
+	for (size_t k=0;k<nAtt;k++) {
+	    const Column& col = ds.column(_att[k]);
+	    // Gather the values of the batch.
+	    if (col.sparse()) {
+		for (size_t i=0;i<m;i++) {
+		    const Attribute att = col[r[i]];
+		    known[i] = att.unknown ? 0 : ~(uint64_t)0;
+		    if (_numeric[k]) {
+			x[i] = att.unknown ? 0 : att.value.num;
+		    } else {
+			nom[i] = att.unknown ? 0 : att.value.nom;
+		    }
+		}
+	    } else {
+		const uint8_t* unknown = &col.unknown()[0];
+		for (size_t i=0;i<m;i++) {
+		    known[i] = unknown[r[i]] ? 0 : ~(uint64_t)0;
+		    if (_numeric[k]) {
+			x[i] = unknown[r[i]] ? 0 : col.num()[r[i]];
+		    } else {
+			nom[i] = unknown[r[i]] ? 0 : col.nom()[r[i]];
+		    }
+		}
+	    }
+
+	    if (_binned[k]) {
+		for (size_t i=0;i<m;i++) {
+		    nom[i] = bin(k, x[i]);
+		}
+	    }
+	    if (!_numeric[k] || _binned[k]) {
+		for (size_t j=0;j<_nClass;j++) {
+		    const double* logPmf = &_logPmf[_pmfOffset[k] + j*_nValue[k]];
+		    double* a = &acc[j*BATCH];
+		    for (size_t i=0;i<m;i++) {
+			if (known[i]) a[i] += logPmf[nom[i]];
+		    }
+		}
+		continue;
+	    }
+	    for (size_t j=0;j<_nClass;j++) {
+		const size_t p = j*nAtt+k;
+		double* a = &acc[j*BATCH];
+		if (_kind[p] == GAUSS_NORMAL) {
+		    gaussKernel(a, &x[0], &known[0], m, 
+			    _mean[p], _halfInvVar[p], _logNorm[p]);
+		    continue;
+		}
+		for (size_t i=0;i<m;i++) {
+		    if (!known[i]) continue;
+		    if (_kind[p] == GAUSS_POINT) {
+			a[i] += fabs(x[i] - _mean[p]) <= DBL_MIN ? 
+			    log(1-DBL_MIN) : log(DBL_MIN);
+		    } else {
+			a[i] += -HUGE_VAL;
+		    }
+		}
+	    }
+	}
+	for (size_t i=0;i<m;i++) {
+	    for (size_t j=0;j<_nClass;j++) {
+		logL[(start+i)*_nClass + j] = _logPrior[j] == -HUGE_VAL ? 
+		    -HUGE_VAL : acc[j*BATCH+i] + _logPrior[j];
+	    }
+	}
+    }
+}
+
+void
+CompiledModel::
+classify_batch(const Dataset& ds, const size_t* rows, const size_t n, 
+	NominalType* label, Scratch& scratch, double* posterior) const
+{
+    vector<double>& logL = scratch.logL;
+    logL.resize(BATCH*_nClass);
+    for (size_t start=0;start<n;start+=BATCH) {
+	const size_t m = min(BATCH, n-start);
+	score_batch(ds, rows+start, m, &logL[0], scratch);
+	for (size_t i=0;i<m;i++) {
+	    label[start+i] = argmax_log_likelihood(&logL[i*_nClass], _nClass, 
+		    posterior ? posterior + (start+i)*_nClass : NULL);
+	}
+    }
+}
@@ -0,0 +1,314 @@
+/**
+ * \file compiledmodel.h
+ * \author Kefei Lu
+ * \brief A trained Naive Bayes model flattened for fast classification.
+ * \sa compiledmodel.cpp
+ */
+
+#ifndef __COMPILEDMODEL_H__
+#define __COMPILEDMODEL_H__
+
+#include "common.h"
+#include "dataset.h"
+#include "classifier.h"
+
+/**
+ * \brief A trained NaiveBayesClassifier, flattened.
+ *
+ * The classifier keeps its model in a table of heap Distribution's, and
+ *   scoring an instance costs a few virtual calls and pointer chases per
+ *   attribute and class. This is the same model in a few contiguous
+ *   arrays, scored by a plain loop without virtual call or allocation.
+ *
+ * Only the attributes used by the classifier are kept, in the order it
+ *   uses them, and the terms are summed in the same order, so that the
+ *   predictions are exactly those of StatisticsClassifier::classify_inst().
+ *
+ * The numeric attributes of a NaiveBayesClassifierDiscrete are binned: 
+ *   their cut points are kept, and the bins scored as nominal values.
+ *
+ * It is a copy: retraining the classifier does not change it.
+ *
+ * It can be saved to a model file, which also holds the schema, and 
+ *   opened again without the classifier or its training data. The 
+ *   arrays are all in one block, the same in memory and in the file, so 
+ *   an opened model is scored right from the mapped file: it starts in 
+ *   no time, and the processes scoring with the same file share one 
+ *   copy of it.
+ */
+class CompiledModel {
+    public:
+	/** How a (class, numeric attribute) is scored. */
+	enum GaussKind {
+	    GAUSS_NORMAL = 0,	///< log_norm - (x-mean)^2 * half_inv_var
+	    GAUSS_POINT,	///< var is 0: all the mass is on mean
+	    GAUSS_INVALID	///< no training value: probability 0
+	};
+	/** The instruction sets of the batch Gaussian kernel. */
+	enum SimdLevel {
+	    SIMD_SCALAR = 0,
+	    SIMD_SSE2,
+	    SIMD_AVX2
+	};
+	/** Number of instances scored together by score_batch(). */
+	static const size_t BATCH = 256;
+
+	/**
+	 * \brief The work buffers of score_batch() and classify_batch().
+	 *
+	 * They are sized on the first call, so that the next ones, by a 
+	 *   model of no more classes, do not allocate. One per thread.
+	 */
+	struct Scratch {
+	    vector<double>	acc;
+	    vector<double>	x;
+	    vector<uint64_t>	known;
+	    vector<NominalCode>	nom;
+	    vector<double>	logL;
+	};
+
+    private:
+	size_t		_nClass;
+	size_t		_classIndex;
+	/** The number of attributes used. */
+	size_t		_nAtt;
+	/** If the classifier used all the attributes. */
+	bool		_useAllAtt;
+	/** The number of elements of _pmf and _logPmf. */
+	size_t		_nPmf;
+	/** The number of elements of _cut. */
+	size_t		_nCut;
+
+	/* ---- The arrays, in _block. ---- */
+	/** The attributes used, in the order they are scored. */
+	const uint64_t*	_att;
+	/** Element [k]: if _att[k] is numeric. */
+	const uint8_t*	_numeric;
+	/** Element [k]: if _att[k] is numeric and binned, and so scored as 
+	 * a nominal one on its bins. */
+	const uint8_t*	_binned;
+
+	/** Element [c]: the prior of class c. */
+	const double*	_pClass;
+	/** Element [c]: log of the prior of class c, -HUGE_VAL if 0. */
+	const double*	_logPrior;
+
+	/** Element [c*_nAtt+k]: parameters of the numeric attribute _att[k]
+	 * given class c. Unused for the nominal ones. */
+	const double*	_mean;
+	const double*	_var;
+	const double*	_halfInvVar;
+	const double*	_logNorm;
+	const uint8_t*	_kind;
+
+	/** Element [k]: where the PMF's of the nominal or binned attribute 
+	 * _att[k] start in _pmf and _logPmf. */
+	const uint64_t*	_pmfOffset;
+	/** Element [k]: the number of possible values, or bins, of _att[k]. */
+	const uint64_t*	_nValue;
+	/** Element [_pmfOffset[k] + c*_nValue[k] + v]: the probability
+	 * of value (or bin) v of the attribute _att[k] given class c. */
+	const double*	_pmf;
+	/** The log of _pmf. */
+	const double*	_logPmf;
+	/** Element [k]: where the _nValue[k]-1 cut points of the binned 
+	 * attribute _att[k] start in _cut. */
+	const uint64_t*	_cutOffset;
+	/** The cut points, ascending for each attribute. */
+	const double*	_cut;
+
+	/** The block of the arrays, if built from a classifier. */
+	vector<uint64_t>	_own;
+	/** The model file, if opened from one. */
+	MappedFile		_file;
+	const char*		_block;
+	size_t			_blockSize;
+
+	/** The schema, if opened from a file. */
+	Dataset			_ownSchema;
+	const Dataset*		_schema;
+
+	/**
+	 * Point the arrays into the block at base, given the sizes.
+	 *
+	 * \return The size of the block.
+	 */
+	size_t layout(const char* base);
+
+	// Not copyable: the arrays point into the object.
+	CompiledModel(const CompiledModel&);
+	CompiledModel& operator=(const CompiledModel&);
+
+    public:
+	/** Flatten the model of a trained classifier. */
+	CompiledModel(const NaiveBayesClassifier& c);
+
+	/**
+	 * \brief Open a model file written by save().
+	 *
+	 * Exits if it is not a model file of this version and byte order.
+	 */
+	CompiledModel(const char* model_file);
+
+	/**
+	 * \brief Save to a model file.
+	 *
+	 * It holds the schema (Dataset::save_schema()), the priors, the 
+	 *   attributes used and their distributions. It can only be read 
+	 *   on a machine of the same byte order.
+	 */
+	void save(const char* model_file) const;
+
+	/**
+	 * \brief Save as a C++ header which scores with this model alone.
+	 *
+	 * The constants are in constexpr arrays (const before C++11), and 
+	 *   the loop on the attributes is unrolled: each attribute used 
+	 *   has its own code, which the compiler can specialize. It needs 
+	 *   neither this library nor the schema. In namespace name:
+	 *
+	 * \verbatim
+	   void log_likelihood(const double* x, double* logL);
+	   unsigned classify(const double* x);
+	   \endverbatim
+	 *
+	 * x[k] is the value of the k-th attribute used, ATT[k] of the 
+	 *   schema: the number, or the index of the nominal value; NaN if 
+	 *   unknown. The results are those of log_likelihood() and 
+	 *   classify(), as long as the header is compiled without fused 
+	 *   multiply-add.
+	 *
+	 * \param name The namespace, a C++ identifier.
+	 */
+	void save_header(const char* header_file, const char* name) const;
+
+	/**
+	 * \brief The schema of the instances the model classifies.
+	 *
+	 * The dataset of the classifier, or one with no instance if the 
+	 *   model was opened from a file. Use it to parse instances 
+	 *   (Dataset::parse_line()).
+	 */
+	const Dataset& schema() const {return *_schema;}
+
+	size_t num_of_class() const {return _nClass;}
+	const size_t& class_index() const {return _classIndex;}
+	/** The number of attributes used. */
+	size_t num_of_att() const {return _nAtt;}
+	/** The k-th attribute used, in the order they are scored. */
+	size_t att(const size_t k) const {return _att[k];}
+	/** If all the attributes are used, rather than only_these_att(). */
+	bool use_all_att() const {return _useAllAtt;}
+	/** The only attributes used, for Classifier::only_these_att(). */
+	vector<size_t> only_these_att() const 
+	{
+	    return vector<size_t>(_att, _att + _nAtt);
+	}
+
+	/** The prior of class c. */
+	double p_class(const size_t c) const {return _pClass[c];}
+	/** If the k-th attribute used is numeric. */
+	bool numeric(const size_t k) const {return _numeric[k];}
+	/** If the k-th attribute used is numeric and binned. */
+	bool binned(const size_t k) const {return _binned[k];}
+	/** The bin of value x of the k-th attribute used, a binned one. 
+	 * As Discretizer::bin(). */
+	size_t bin(const size_t k, const double x) const
+	{
+	    return Discretizer::bin(_cut + _cutOffset[k], _nValue[k]-1, x);
+	}
+	/** How the k-th attribute used, a numeric one, is scored on class c. */
+	GaussKind kind(const size_t c, const size_t k) const
+	{
+	    return (GaussKind)_kind[c*_nAtt+k];
+	}
+	/** Mean and variance of the k-th attribute used, a numeric one, 
+	 * given class c. */
+	double mean(const size_t c, const size_t k) const {return _mean[c*_nAtt+k];}
+	double var(const size_t c, const size_t k) const {return _var[c*_nAtt+k];}
+	double half_inv_var(const size_t c, const size_t k) const 
+	{
+	    return _halfInvVar[c*_nAtt+k];
+	}
+	double log_norm(const size_t c, const size_t k) const {return _logNorm[c*_nAtt+k];}
+	/** The number of possible values, or bins, of the k-th attribute used. */
+	size_t num_of_value(const size_t k) const {return _nValue[k];}
+	/** Probability of value (or bin) v of the k-th attribute used, a 
+	 * nominal or binned one, given class c. */
+	double pmf(const size_t c, const size_t k, const size_t v) const
+	{
+	    return _pmf[_pmfOffset[k] + c*_nValue[k] + v];
+	}
+	double log_pmf(const size_t c, const size_t k, const size_t v) const
+	{
+	    return _logPmf[_pmfOffset[k] + c*_nValue[k] + v];
+	}
+
+	/** Log of the prior times the probability of inst given class c.
+	 *
+	 * The same as StatisticsClassifier::log_likelihood(). */
+	double log_likelihood(const NominalType c, const InstanceRef& inst) const;
+
+	/** Classify inst: the class of the largest log_likelihood(). */
+	NominalType classify(const InstanceRef& inst) const;
+
+	/**
+	 * \brief Score a batch of instances of a dataset on all classes.
+	 *
+	 * The instances are taken BATCH at a time, and each numeric 
+	 *   attribute is scored on all of them for a class in one call to a 
+	 *   vector kernel (see simd_level()). The terms are summed in the 
+	 *   same order as by log_likelihood(), and the results are the same.
+	 *
+	 * \param ds The dataset, of the schema the model was trained on.
+	 * \param rows The n rows of ds to score.
+	 * \param logL Element [i*num_of_class()+c] is set to the 
+	 *   log_likelihood() of class c of row rows[i].
+	 * \param scratch The work buffers, to be kept by a caller scoring 
+	 *   batch after batch. Without, they are allocated for the call.
+	 */
+	void score_batch(const Dataset& ds, const size_t* rows, const size_t n, 
+		double* logL, Scratch& scratch) const;
+	void score_batch(const Dataset& ds, const size_t* rows, const size_t n, 
+		double* logL) const
+	{
+	    Scratch scratch;
+	    score_batch(ds, rows, n, logL, scratch);
+	}
+	/**
+	 * \brief Classify a batch of instances of a dataset.
+	 *
+	 * The same as classify() on each, using score_batch().
+	 *
+	 * \param label label[i] is set to the class of row rows[i].
+	 * \param posterior If not NULL, element [i*num_of_class()+c] is set 
+	 *   to the a posteriori probability of class c of row rows[i].
+	 * \param scratch As of score_batch().
+	 */
+	void classify_batch(const Dataset& ds, const size_t* rows, const size_t n, 
+		NominalType* label, Scratch& scratch, 
+		double* posterior = NULL) const;
+	void classify_batch(const Dataset& ds, const size_t* rows, const size_t n, 
+		NominalType* label, double* posterior = NULL) const
+	{
+	    Scratch scratch;
+	    classify_batch(ds, rows, n, label, scratch, posterior);
+	}
+
+	/**
+	 * The instruction set used by score_batch(): the best one the 
+	 * processor supports, chosen at run time.
+	 */
+	static SimdLevel simd_level();
+	/**
+	 * Use another instruction set, for testing and benchmarks. It is 
+	 * lowered to the best supported. Not thread safe.
+	 *
+	 * \return The level actually used.
+	 */
+	static SimdLevel set_simd_level(SimdLevel level);
+	/** Name of a SimdLevel. */
+	static const char* simd_name(SimdLevel level);
+};
+
+#endif
@@ -6,9 +6,10 @@
  */
 
 #include "dataset.h"
+#include "parallel.h"
+#include <sys/stat.h>
 using namespace std;
 
-#define MAX_LINE_CHAR 20000
 //#define __DATASET_DEBUG__
 
 AttDesc& 
@@ -44,27 +45,68 @@ AttDesc::clear()
     strcpy(name, "");
     type = ATT_TYPE_NONE;
     possibleValues->clear();
+    valueIndex.clear();
+    nIndexed = 0;
     return *this;
 }
 
-size_t 
-AttDesc::map(const string str) const
+AttDesc&
+AttDesc::index_values()
 {
-    assert(type==ATT_TYPE_NOMINAL);
-    vector<string>::iterator it;
-    for ( it=(*possibleValues).begin(); it <(*possibleValues).end(); it++)
-    {
-	if (*it == str) return it -(*possibleValues).begin();
+    const size_t n = possibleValues->size();
+    size_t nSlot = 1;
+    while (nSlot < 2*n) nSlot <<= 1;
+    valueIndex.assign(nSlot, 0);
+    for (size_t i=0; i<n; i++) {
+	const string& v = (*possibleValues)[i];
+	size_t slot = hash(v.data(), v.size()) & (nSlot-1);
+	while (valueIndex[slot]) {
+	    // A duplicated value keeps its first index, as the scan does.
+	    if ((*possibleValues)[valueIndex[slot]-1] == v) break;
+	    slot = (slot+1) & (nSlot-1);
+	}
+	if (!valueIndex[slot]) valueIndex[slot] = i+1;
     }
-    fprintf(stderr, "(E) Invalid possible value: %s\n", str.c_str());
-    exit(1);
+    nIndexed = n;
+    return *this;
+}
+
+size_t 
+AttDesc::map(const string& str) const
+{
+    return map(str.data(), str.size());
 }
 
 size_t
 AttDesc::map(const char* str) const
+{
+    return map(str, strlen(str));
+}
+
+size_t
+AttDesc::map(const char* str, const size_t len) const
 {
     assert(type==ATT_TYPE_NOMINAL);
-    return map(string(str));
+    const vector<string>& values = *possibleValues;
+    if (!valueIndex.empty() && nIndexed == values.size()) {
+	const size_t mask = valueIndex.size()-1;
+	size_t slot = hash(str, len) & mask;
+	while (valueIndex[slot]) {
+	    const string& v = values[valueIndex[slot]-1];
+	    if (v.size() == len && memcmp(v.data(), str, len) == 0) {
+		return valueIndex[slot]-1;
+	    }
+	    slot = (slot+1) & mask;
+	}
+    } else {
+	// Not indexed (yet).
+	for (size_t i=0; i<values.size(); i++) {
+	    const string& v = values[i];
+	    if (v.size() == len && memcmp(v.data(), str, len) == 0) return i;
+	}
+    }
+    fprintf(stderr, "(E) Invalid possible value: %.*s\n", (int)len, str);
+    exit(1);
 }
 
 string
@@ -79,6 +121,7 @@ AttDesc::AttDesc(const char* name = "", const AttType type = ATT_TYPE_NONE)
     set_name_and_type(name,type);
     possibleValues = new vector<string>;
     possibleValues->clear();
+    nIndexed = 0;
 }
 
 AttDesc::AttDesc(const AttDesc& desc)
@@ -88,15 +131,88 @@ AttDesc::AttDesc(const AttDesc& desc)
     for (size_t i=0; i<desc.possible_value_vector().size(); i++) {
 	(*possibleValues).push_back( (desc.possible_value_vector())[i] );
     }
+    valueIndex = desc.valueIndex;
+    nIndexed = desc.nIndexed;
 }
 
 AttDesc&
 AttDesc::operator=(const AttDesc& desc)
 {
+    if (this == &desc) return *this;
     set_name_and_type(desc.get_name(), desc.get_type());
+    (*possibleValues).clear();
     for (size_t i=0; i<desc.possible_value_vector().size(); i++) {
 	(*possibleValues).push_back( (desc.possible_value_vector())[i] );
     }
+    valueIndex = desc.valueIndex;
+    nIndexed = desc.nIndexed;
+    return *this;
+}
+
+void
+Column::reserve(const size_t n)
+{
+    if (_sparse) return; // unknown how many are stored
+    _unknown.reserve(n);
+    if (_type == ATT_TYPE_NUMERIC) {
+	_num.reserve(n);
+    } else {
+	_nom.reserve(n);
+    }
+}
+
+void
+Column::clear()
+{
+    _nRow = 0;
+    _row.clear();
+    _num.clear();
+    _nom.clear();
+    _unknown.clear();
+}
+
+Column&
+Column::append(const Column& col)
+{
+    assert(col.type() == type());
+    assert(col.sparse() == sparse());
+    for (size_t k=0; k<col._row.size(); k++) {
+	_row.push_back(col._row[k] + _nRow);
+    }
+    _num.insert(_num.end(), col._num.begin(), col._num.end());
+    _nom.insert(_nom.end(), col._nom.begin(), col._nom.end());
+    _unknown.insert(_unknown.end(), col._unknown.begin(), col._unknown.end());
+    _nRow += col._nRow;
+    return *this;
+}
+
+Column&
+Column::assign(const void* values, const uint8_t* unknown, const size_t n)
+{
+    clear();
+    _sparse = 0;
+    _nRow = n;
+    _unknown.assign(unknown, unknown + n);
+    if (_type == ATT_TYPE_NUMERIC) {
+	const NumericType* v = (const NumericType*)values;
+	_num.assign(v, v + n);
+    } else {
+	const NominalCode* v = (const NominalCode*)values;
+	_nom.assign(v, v + n);
+    }
+    return *this;
+}
+
+Column&
+Column::densify()
+{
+    if (!_sparse) return *this;
+    Column dense(_type, 0);
+    dense.reserve(_nRow);
+    for (size_t i=0; i<_nRow; i++) {
+	dense.push_back((*this)[i]);
+    }
+    *this = dense;
     return *this;
 }
 
@@ -105,141 +221,878 @@ Dataset::init()
 {
     _numOfInstance = 0;
     _numOfAttributes = 0;
-    _inst.clear();
+    _col.clear();
     _attDesc.clear();
     return;
 }
 
-Dataset& 
-Dataset::read_arff( const char* arff_file )
+Dataset&
+Dataset::add_att(const AttDesc& desc)
 {
-    fprintf( stdout, "(I) Opening file: %s...\n", arff_file );
-    FILE* arff = fopen( arff_file, "r" );
-    if (!arff) {
-	fprintf(stderr, "(E) Opening file %s failed.\n", arff_file);
+    assert(num_of_inst() == 0);
+    _attDesc.push_back(desc);
+    if (desc.get_type() == ATT_TYPE_NOMINAL) _attDesc.back().index_values();
+    _col.push_back(Column(desc.get_type()));
+    _numOfAttributes = _attDesc.size();
+    return *this;
+}
+
+Dataset&
+Dataset::push_back(const Instance& inst)
+{
+    assert(inst.size() == num_of_att());
+    for (size_t j=0; j<_numOfAttributes; j++) {
+	_col[j].push_back(inst[j]);
+    }
+    _numOfInstance ++;
+    return *this;
+}
+
+/** Delimiters between two values in a data line. */
+static inline bool
+is_data_delim(const char c)
+{
+    return c == ',' || c == ' ';
+}
+
+void
+Dataset::parse_value(const size_t i, const char* result, const size_t len, 
+	Attribute& tmpatt) const
+{
+    tmpatt.value.num = 0;
+    tmpatt.unknown = 0;
+    const bool unknown = (len == 1 && result[0] == '?');
+    // first check the corresponding attDesc,
+    if ( _attDesc[i].get_type() == ATT_TYPE_NUMERIC ) {
+	//   if numeric then string -> double, store.
+	if ( unknown ) {
+	    // Attribute unknown
+	    tmpatt.unknown = 1;
+	} else {
+	    char * tailptr = NULL;
+	    tmpatt.value.num = NumericType(strtod(result, &tailptr));
+	    if (tailptr == result) {
+		fprintf(stderr, "(E) Processing invalue numeric value: %.*s\n",
+			(int)len, result);
+		exit(1);
+	    }
+	}
+
+    } else if ( _attDesc[i].get_type() == ATT_TYPE_NOMINAL ) {
+	//   if nominal then string -> index of possible values, store.
+	if ( unknown ) {
+	    tmpatt.unknown = 1;
+	} else {
+	    tmpatt.value.nom = NominalType(_attDesc[i].map(result, len));
+	}
+
+    } else {
+	fprintf(stderr, "(E) Type must be either numeric or nominal.\n");
 	exit(1);
     }
+}
 
-    init();
+size_t
+Dataset::parse_sparse_line(const char* line, const char* eol, Instance& inst) const
+{
+    // Every value not listed is the default one.
+    for (size_t i=0; i<inst.size(); i++) {
+	inst[i] = Attribute();
+    }
+    const char* p = (const char*)memchr(line, '{', eol - line) + 1;
+    while (1) {
+	while (p < eol && is_data_delim(*p)) p++;
+	if (p == eol) {
+	    fprintf(stderr, "(E) Sparse instance without '}': %.*s\n",
+		    (int)(eol - line), line);
+	    exit(1);
+	}
+	if (*p == '}') break;
+	// "index value"
+	char* tailptr = NULL;
+	const size_t i = strtoul(p, &tailptr, 10);
+	if (tailptr == p || i >= _attDesc.size()) {
+	    fprintf(stderr, "(E) Invalid attribute index in line: %.*s\n",
+		    (int)(eol - line), line);
+	    exit(1);
+	}
+	p = tailptr;
+	while (p < eol && *p == ' ') p++;
+	const char* result = p;
+	while (p < eol && !is_data_delim(*p) && *p != '}') p++;
+	parse_value(i, result, p - result, inst[i]);
+    }
+    return 1;
+}
 
-    AttDesc desc;
+size_t
+Dataset::parse_line(const char* line, const char* eol, Instance& inst) const
+{
+    inst.resize(_attDesc.size());
+    const char* p = line;
+    while (p < eol && *p == ' ') p++;
+    if (p < eol && *p == '{') return parse_sparse_line(line, eol, inst);
+
+    size_t i = 0; // current attribute
+    // we are now in data section. get instances.
+    while (1) {
+	while (p < eol && is_data_delim(*p)) p++;
+	if (p == eol) break;
+	const char* result = p;
+	while (p < eol && !is_data_delim(*p)) p++;
+
+	if (i >= _attDesc.size()) {
+	    fprintf(stderr, "(E) Too many values in line: %.*s\n",
+		    (int)(eol - line), line);
+	    exit(1);
+	}
+	parse_value(i, result, p - result, inst[i]);
+	i++;
+    } // reading data section
+    if (i == 0) return 0; // blank line
+    // Check if inst have same numOfAtt as in _attDesc:
+    assert(i == _attDesc.size());
+    return 1;
+}
+
+size_t
+Dataset::parse_data(const char* begin, const char* end, 
+	vector<Column>& col) const
+{
+    size_t n = 0;
     Instance inst;
-    char buf[MAX_LINE_CHAR];
+    const char* line = begin;
+    while (line < end) {
+	const char* eol = (const char*)memchr(line, '\n', end - line);
+	string last;
+	if (!eol) {
+	    // The last line has no newline: strtod() could run past the end 
+	    // of the mapping, so parse a terminated copy of it instead.
+	    last.assign(line, end);
+	    last += '\n';
+	    line = last.data();
+	    eol = last.data() + last.size() - 1;
+	    end = eol;
+	}
+	if (parse_line(line, eol, inst)) {
+	    for (size_t j=0; j<col.size(); j++) {
+		col[j].push_back(inst[j]);
+	    }
+	    n ++;
+	}
+	line = eol + 1;
+    }
+    return n;
+}
+
+/** A chunk of the data section, parsed by one thread. */
+struct ParseChunk {
+    const char*		begin;
+    const char*		end;
+    vector<Column>	col;
+    size_t		nInst;
+};
+
+/** Everything the parsing threads share. */
+struct ParseJobs {
+    const Dataset*	ds;
+    size_t (Dataset::*parse)(const char*, const char*, vector<Column>&) const;
+    vector<ParseChunk>	chunk;
+};
+
+static void
+parse_chunk(const size_t i, void* arg)
+{
+    ParseJobs* jobs = (ParseJobs*)arg;
+    ParseChunk& c = jobs->chunk[i];
+    c.nInst = (jobs->ds->*(jobs->parse))(c.begin, c.end, c.col);
+}
+
+void
+Dataset::parse_data_parallel(const char* begin, const char* end, 
+	const size_t nThread)
+{
+    ParseJobs jobs;
+    jobs.ds = this;
+    jobs.parse = &Dataset::parse_data;
+    jobs.chunk.resize(nThread);
+
+    // Cut on newline boundaries.
+    const size_t len = end - begin;
+    const char* p = begin;
+    for (size_t i=0; i<nThread; i++) {
+	ParseChunk& c = jobs.chunk[i];
+	c.begin = p;
+	if (i == nThread-1) {
+	    p = end;
+	} else {
+	    const char* cut = begin + len / nThread * (i+1);
+	    if (cut < p) cut = p;
+	    const char* eol = (const char*)memchr(cut, '\n', end - cut);
+	    p = eol ? eol + 1 : end;
+	}
+	c.end = p;
+	c.col = _col; // empty columns of the right types
+	c.nInst = 0;
+    }
+
+    run_parallel(parse_chunk, &jobs, nThread, nThread);
+
+    // Stitch the chunks in file order.
+    size_t total = 0;
+    for (size_t i=0; i<nThread; i++) total += jobs.chunk[i].nInst;
+    for (size_t j=0; j<_col.size(); j++) _col[j].reserve(total);
+    for (size_t i=0; i<nThread; i++) {
+	ParseChunk& c = jobs.chunk[i];
+	for (size_t j=0; j<_col.size(); j++) {
+	    _col[j].append(c.col[j]);
+	    c.col[j].clear();
+	}
+    }
+    _numOfInstance += total;
+}
+
+int
+Dataset::parse_header_line(char* buf)
+{
+    AttDesc desc;
     char* result = NULL;
-    short int flag_data_begin = 0;
 
-    fprintf( stdout, "(I) Loading attributes and instances...\n" );
-    while (fgets(buf, MAX_LINE_CHAR, arff) != NULL) {
-	if (!flag_data_begin) {
-	    // still looking for @command
-	    desc.clear();
-	    // Parse the first word.
-	    result = strtok(buf, " \n");
-	    if (result == NULL) continue;
-	    if (strcmp(result, "@attribute") == 0) {
-		result = strtok(NULL, " \n"); // name
-		assert(result);
-		desc.set_name(result);
-		result = strtok(NULL, " \n"); // type
-		assert(result);
-
-		if (strcmp(result,"numeric")==0) {
-		    // Numeric type
-		    desc.set_type(ATT_TYPE_NUMERIC);
+    // still looking for @command
+    // Parse the first word.
+    result = strtok(buf, " \n");
+    if (result == NULL) return 0;
+    if (strcmp(result, "@attribute") == 0) {
+	result = strtok(NULL, " \n"); // name
+	assert(result);
+	desc.set_name(result);
+	result = strtok(NULL, " \n"); // type
+	assert(result);
+
+	if (strcmp(result,"numeric")==0) {
+	    // Numeric type
+	    desc.set_type(ATT_TYPE_NUMERIC);
 #ifdef __DATASET_DEBUG__
-		    cout << desc.get_name() << " " << desc.get_type() << " ";
-		    cout << endl;
+	    cout << desc.get_name() << " " << desc.get_type() << " ";
+	    cout << endl;
 #endif
-		    _attDesc.push_back(desc);
-		}
-		else if (result[0] == '{') {
-		    // Nominal type
-		    desc.set_type(ATT_TYPE_NOMINAL);
+	    _attDesc.push_back(desc);
+	}
+	else if (result[0] == '{') {
+	    // Nominal type
+	    desc.set_type(ATT_TYPE_NOMINAL);
 #ifdef __DATASET_DEBUG__
-		    cout << desc.get_name() << " " << desc.get_type() << " ";
+	    cout << desc.get_name() << " " << desc.get_type() << " ";
 #endif
-		    char * tmp = result;
-		    while((result = strtok(tmp, "{, }\n"))!=NULL) {
-			tmp = NULL;
-			// read all possible values
+	    char * tmp = result;
+	    while((result = strtok(tmp, "{, }\n"))!=NULL) {
+		tmp = NULL;
+		// read all possible values
 #ifdef __DATASET_DEBUG__
-			cout << result << " ";
+		cout << result << " ";
 #endif
-			desc.possible_value_vector().push_back(result);
-		    }
+		desc.possible_value_vector().push_back(result);
+	    }
 #ifdef __DATASET_DEBUG__
-		    cout << endl;
+	    cout << endl;
 #endif
-		    _attDesc.push_back(desc);
-		}
-	    }
-	    else if (strcmp(result, "@data") == 0) {
-		// End of Attribute desc, Begin of dataset
-		flag_data_begin = 1;
-	    }
+	    desc.index_values();
+	    _attDesc.push_back(desc);
 	}
-	else {
-	    inst.clear();
-	    char* buftmp = new char [MAX_LINE_CHAR];
-	    char * buftmp_orig = buftmp;
-	    strcpy(buftmp, buf);
-	    // we are now in data section. get instances.
-	    while ((result = strtok(buftmp, ", \n"))!=NULL) {
-
-		buftmp = NULL; // because following strtok call must have NULL str.
-		size_t i = inst.size();
-		Attribute tmpatt;
-		// first check the corresponding attDesc,
-		if ( _attDesc[i].get_type() == ATT_TYPE_NUMERIC ) {
-		    //   if numeric then string -> double, store.
-		    if ( strcmp(result, "?") == 0 ) {
-			// Attribute unknown
-			tmpatt.unknown = 1;
-		    } else {
-			char * tailptr = NULL;
-			tmpatt.value.num = NumericType(strtod(result, &tailptr));
-			if (tailptr == result) {
-			    fprintf(stderr, "(E) Processing invalue numeric value: %s\n", result);
-			    exit(1);
-			}
-		    }
-		    inst.push_back(tmpatt);
-
-		} else if ( _attDesc[i].get_type() == ATT_TYPE_NOMINAL ) {
-		    //   if nominal then string -> index of possible values, store.
-		    if ( strcmp(result, "?") == 0 ) {
-			tmpatt.unknown = 1;
-		    } else {
-			tmpatt.value.nom = NominalType(_attDesc[i].map(result));
-		    }
-		    inst.push_back(tmpatt);
-
-		} else {
-		    fprintf(stderr, "(E) Type must be either numeric or nominal.\n");
-		    exit(1);
-		}
-	    } // reading data section
-	    delete [] buftmp_orig;
-	    // Check if inst have same numOfAtt as in _attDesc:
-	    assert(inst.size() == _attDesc.size());
-	    _inst.push_back(inst);
-	}
-    } // read every line into buf
-    // Finalize
+    }
+    else if (strcmp(result, "@data") == 0) {
+	// End of Attribute desc, Begin of dataset
+	return 1;
+    }
+    return 0;
+}
+
+void
+Dataset::end_header(const bool sparse)
+{
+    // One column for each attribute.
     _numOfAttributes = _attDesc.size();
-    _numOfInstance = _inst.size();
+    for (size_t i=0; i<_numOfAttributes; i++) {
+	_col.push_back(Column(_attDesc[i].get_type(), sparse));
+    }
+}
+
+/** If the first instance in [line, end) is a sparse one. */
+static bool
+first_line_is_sparse(const char* line, const char* end)
+{
+    while (line < end && (*line == ' ' || *line == '\n' || *line == '\r')) {
+	line ++;
+    }
+    return line < end && *line == '{';
+}
+
+Dataset& 
+Dataset::read_arff( const char* arff_file, size_t nThread )
+{
+    fprintf( stdout, "(I) Opening file: %s...\n", arff_file );
+    MappedFile arff;
+    if (arff.open(arff_file) != 0) {
+	fprintf(stderr, "(E) Opening file %s failed.\n", arff_file);
+	exit(1);
+    }
+
+    init();
+
+    vector<char> buf;
+    const char* line = arff.data();
+    const char* const end = arff.data() + arff.size();
+
+    fprintf( stdout, "(I) Loading attributes and instances...\n" );
+    // The header is small: each line is copied out and strtok'ed.
+    while (line < end) {
+	const char* eol = (const char*)memchr(line, '\n', end - line);
+	if (!eol) eol = end;
+	buf.assign(line, eol);
+	buf.push_back('\0');
+	line = eol + 1;
+	if (parse_header_line(&buf[0])) break;
+    }
+    end_header(first_line_is_sparse(line, end));
+
+    // Then the data section, in place.
+    if (nThread == 0) nThread = num_of_cpu();
+    if (line >= end) {
+	// No data.
+    } else if (nThread > 1) {
+	parse_data_parallel(line, end, nThread);
+    } else {
+	_numOfInstance = parse_data(line, end, _col);
+    }
+    // Sparse storage only pays off if most values are not stored.
+    for (size_t j=0; j<_numOfAttributes; j++) {
+	if (_col[j].sparse() && _col[j].row().size()*2 > _numOfInstance) {
+	    _col[j].densify();
+	}
+    }
 
     fprintf( stdout, "(I) Read %d attributes, %d instances.\n", 
 	    _numOfAttributes, _numOfInstance );
 
-    fclose(arff);
+    arff.close();
     fprintf( stdout, "(I) File %s closed.\n", arff_file );
 
     return *this;
 }
 
-Dataset::Dataset(const char* arff_file)
+Dataset::Dataset(const char* arff_file, const size_t nThread)
 {
-    read_arff(arff_file);
+    read_arff(arff_file, nThread);
 }
 
+/* ---- Binary dataset file ----
+ *
+ * \verbatim
+   BinHeader
+   for each attribute:
+       uint32 type, uint32 name length, name,
+       uint32 num of possible values,
+         for each: uint32 length, value
+       (padded to 8 bytes)
+   for each attribute:
+       unknown mask, num_of_inst() bytes (padded to 8 bytes)
+       values, num_of_inst() NumericType or NominalCode (padded to 8 bytes)
+   \endverbatim
+ */
+
+#define BIN_MAGIC "NB4ITDS"
+#define BIN_VERSION 2
+#define BIN_BYTE_ORDER 0x01020304u
+
+/** Header of a binary dataset file. */
+struct BinHeader {
+    char	magic[8];
+    uint32_t	version;
+    uint32_t	byteOrder; ///< BIN_BYTE_ORDER as written.
+    uint64_t	nAtt;
+    uint64_t	nInst;
+    /** The ARFF file cached, all 0 if not a cache: its size, 
+     * modification time in seconds and nanoseconds, device and inode. */
+    uint64_t	srcSize;
+    int64_t	srcMtime;
+    int64_t	srcMtimeNsec;
+    uint64_t	srcDev;
+    uint64_t	srcIno;
+};
+
+/** Set the fields of h on the ARFF file cached to those of src, if not 
+ * NULL. */
+static void
+bin_source(BinHeader& h, const struct stat* src)
+{
+    if (!src) return;
+    h.srcSize = src->st_size;
+    h.srcMtime = src->st_mtime;
+#ifdef linux
+    h.srcMtimeNsec = src->st_mtim.tv_nsec;
+#endif
+    h.srcDev = src->st_dev;
+    h.srcIno = src->st_ino;
+}
+
+/** If h is the header of a cache of the file of src. */
+static bool
+bin_cache_of(const BinHeader& h, const struct stat& src)
+{
+    BinHeader s;
+    memset(&s, 0, sizeof(s));
+    bin_source(s, &src);
+    return h.srcSize == s.srcSize && h.srcMtime == s.srcMtime
+	&& h.srcMtimeNsec == s.srcMtimeNsec
+	&& h.srcDev == s.srcDev && h.srcIno == s.srcIno;
+}
+
+/* The writes do not check each fwrite(): an error is sticky, and checked 
+ * by ferror() once the file is written. */
+static void
+bin_write(FILE* fp, const void* p, const size_t n)
+{
+    if (n) fwrite(p, 1, n, fp);
+}
+
+static void
+bin_write_u32(FILE* fp, const uint32_t v)
+{
+    bin_write(fp, &v, sizeof(v));
+}
+
+static void
+bin_pad(FILE* fp)
+{
+    static const char zero[8] = {0};
+    long pos = ftell(fp);
+    bin_write(fp, zero, (8 - pos % 8) % 8);
+}
+
+void
+Dataset::save_schema( FILE* fp, const char* bin_file ) const
+{
+    for (size_t j=0; j<num_of_att(); j++) {
+	const AttDesc& desc = get_att_desc(j);
+	bin_write_u32(fp, desc.get_type());
+	bin_write_u32(fp, strlen(desc.get_name()));
+	bin_write(fp, desc.get_name(), strlen(desc.get_name()));
+	const vector<string>& values = desc.possible_value_vector();
+	bin_write_u32(fp, values.size());
+	for (size_t k=0; k<values.size(); k++) {
+	    bin_write_u32(fp, values[k].size());
+	    bin_write(fp, values[k].data(), values[k].size());
+	}
+	bin_pad(fp);
+    }
+}
+
+int
+Dataset::write_binary( const char* bin_file, const struct stat* src ) const
+{
+    FILE* fp = fopen(bin_file, "wb");
+    if (!fp) return -1;
+
+    BinHeader h;
+    memset(&h, 0, sizeof(h));
+    strcpy(h.magic, BIN_MAGIC);
+    h.version = BIN_VERSION;
+    h.byteOrder = BIN_BYTE_ORDER;
+    h.nAtt = num_of_att();
+    h.nInst = num_of_inst();
+    bin_source(h, src);
+    bin_write(fp, &h, sizeof(h));
+    save_schema(fp, bin_file);
+
+    for (size_t j=0; j<num_of_att(); j++) {
+	// The file is dense.
+	Column dense;
+	if (column(j).sparse()) {
+	    dense = column(j);
+	    dense.densify();
+	}
+	const Column& col = column(j).sparse() ? dense : column(j);
+	const size_t n = num_of_inst();
+	if (!n) continue;
+	bin_write(fp, &col.unknown()[0], n);
+	bin_pad(fp);
+	if (col.type() == ATT_TYPE_NUMERIC) {
+	    bin_write(fp, &col.num()[0], n*sizeof(NumericType));
+	} else {
+	    bin_write(fp, &col.nom()[0], n*sizeof(NominalCode));
+	}
+	bin_pad(fp);
+    }
+
+    const bool failed = ferror(fp);
+    if (fclose(fp) != 0 || failed) return -1;
+    return 0;
+}
+
+const Dataset&
+Dataset::save_binary( const char* bin_file, const struct stat* src ) const
+{
+    if (write_binary(bin_file, src) != 0) {
+	fprintf(stderr, "(E) Writing file %s failed.\n", bin_file);
+	remove(bin_file);
+	exit(1);
+    }
+    return *this;
+}
+
+const Dataset&
+Dataset::save_arff( const char* arff_file ) const
+{
+    FILE* fp = fopen(arff_file, "w");
+    if (!fp) {
+	fprintf(stderr, "(E) Opening file %s failed.\n", arff_file);
+	exit(1);
+    }
+
+    fprintf(fp, "@relation nb4it\n\n");
+    for (size_t j=0; j<num_of_att(); j++) {
+	const AttDesc& desc = get_att_desc(j);
+	fprintf(fp, "@attribute %s ", desc.get_name());
+	if (desc.get_type() == ATT_TYPE_NUMERIC) {
+	    fprintf(fp, "numeric\n");
+	    continue;
+	}
+	const vector<string>& values = desc.possible_value_vector();
+	fputc('{', fp);
+	for (size_t v=0; v<values.size(); v++) {
+	    fprintf(fp, "%s%s", v ? "," : "", values[v].c_str());
+	}
+	fprintf(fp, "}\n");
+    }
+
+    fprintf(fp, "\n@data\n");
+    for (size_t i=0; i<num_of_inst(); i++) {
+	for (size_t j=0; j<num_of_att(); j++) {
+	    if (j) fputc(',', fp);
+	    const Attribute att = column(j)[i];
+	    if (att.unknown) {
+		fputc('?', fp);
+	    } else if (column(j).type() == ATT_TYPE_NUMERIC) {
+		fprintf(fp, "%.17g", att.value.num);
+	    } else {
+		fputs(get_att_desc(j).possible_value_vector()[att.value.nom].c_str(), fp);
+	    }
+	}
+	fputc('\n', fp);
+    }
+
+    if (fclose(fp) != 0) {
+	fprintf(stderr, "(E) Writing file %s failed.\n", arff_file);
+	exit(1);
+    }
+    return *this;
+}
+
+/** A cursor reading a binary dataset file in memory. */
+class BinReader {
+    private:
+	const char*	_begin;
+	const char*	_p;
+	const char*	_end;
+	const char*	_file;
+    public:
+	BinReader(const MappedFile& f, const char* file)
+	    : _begin(f.data()), _p(f.data()), _end(f.data() + f.size()), 
+	      _file(file) {}
+	BinReader(const char* begin, const size_t size, const char* file)
+	    : _begin(begin), _p(begin), _end(begin + size), _file(file) {}
+	/** The bytes read so far. */
+	size_t pos() const {return _p - _begin;}
+	/** Get n bytes, and move on. */
+	const char* take(const size_t n)
+	{
+	    if ((size_t)(_end - _p) < n) {
+		fprintf(stderr, "(E) File %s is truncated.\n", _file);
+		exit(1);
+	    }
+	    const char* p = _p;
+	    _p += n;
+	    return p;
+	}
+	uint32_t take_u32()
+	{
+	    uint32_t v;
+	    memcpy(&v, take(sizeof(v)), sizeof(v));
+	    return v;
+	}
+	void pad()
+	{
+	    take((8 - (_p - _begin) % 8) % 8);
+	}
+};
+
+/**
+ * Read and check the header of a binary dataset file.
+ *
+ * \return 0 if it is one, -1 otherwise.
+ */
+static int
+bin_header(const MappedFile& f, BinHeader& h)
+{
+    if (f.size() < sizeof(h)) return -1;
+    memcpy(&h, f.data(), sizeof(h));
+    if (memcmp(h.magic, BIN_MAGIC, sizeof(BIN_MAGIC)) != 0) return -1;
+    if (h.version != BIN_VERSION) return -1;
+    if (h.byteOrder != BIN_BYTE_ORDER) return -1;
+    return 0;
+}
+
+size_t
+Dataset::open_schema( const char* begin, const size_t size, 
+	const size_t nAtt, const char* bin_file )
+{
+    init();
+    BinReader r(begin, size, bin_file);
+    AttDesc desc;
+    for (size_t j=0; j<nAtt; j++) {
+	desc.clear();
+	AttType type = AttType(r.take_u32());
+	if (type != ATT_TYPE_NUMERIC && type != ATT_TYPE_NOMINAL) {
+	    fprintf(stderr, "(E) Type must be either numeric or nominal.\n");
+	    exit(1);
+	}
+	size_t len = r.take_u32();
+	string name(r.take(len), len);
+	desc.set_name_and_type(name.c_str(), type);
+	size_t nValue = r.take_u32();
+	for (size_t k=0; k<nValue; k++) {
+	    len = r.take_u32();
+	    desc.possible_value_vector().push_back(string(r.take(len), len));
+	}
+	if (type == ATT_TYPE_NOMINAL) desc.index_values();
+	r.pad();
+	_attDesc.push_back(desc);
+    }
+    end_header();
+    return r.pos();
+}
+
+size_t
+Dataset::parse_binary( const MappedFile& f, const char* bin_file, 
+	vector<const uint8_t*>& unknown, vector<const char*>& values )
+{
+    BinHeader h;
+    if (bin_header(f, h) != 0) {
+	fprintf(stderr, "(E) %s is not a binary dataset file "
+		"of this version and byte order.\n", bin_file);
+	exit(1);
+    }
+
+    BinReader r(f, bin_file);
+    r.take(sizeof(h));
+    r.take(open_schema(f.data() + r.pos(), f.size() - r.pos(), h.nAtt, bin_file));
+
+    const size_t n = h.nInst;
+    unknown.assign(_numOfAttributes, NULL);
+    values.assign(_numOfAttributes, NULL);
+    if (!n) return 0;
+    if (n > f.size()) {
+	fprintf(stderr, "(E) File %s is truncated.\n", bin_file);
+	exit(1);
+    }
+    for (size_t j=0; j<_numOfAttributes; j++) {
+	unknown[j] = (const uint8_t*)r.take(n);
+	r.pad();
+	if (_attDesc[j].get_type() == ATT_TYPE_NUMERIC) {
+	    values[j] = r.take(n*sizeof(NumericType));
+	} else {
+	    values[j] = r.take(n*sizeof(NominalCode));
+	    // The codes index the possible values, and the PMF's later.
+	    const NominalCode* code = (const NominalCode*)values[j];
+	    const size_t nValue = _attDesc[j].possible_value_vector().size();
+	    for (size_t i=0; i<n; i++) {
+		if (!unknown[j][i] && code[i] >= nValue) {
+		    fprintf(stderr, "(E) File %s is corrupted: a value of "
+			    "attribute %s is out of its possible values.\n", 
+			    bin_file, _attDesc[j].get_name());
+		    exit(1);
+		}
+	    }
+	}
+	r.pad();
+    }
+    return n;
+}
+
+Dataset&
+Dataset::open_binary( const char* bin_file )
+{
+    fprintf( stdout, "(I) Opening binary file: %s...\n", bin_file );
+    MappedFile f;
+    if (f.open(bin_file) != 0) {
+	fprintf(stderr, "(E) Opening file %s failed.\n", bin_file);
+	exit(1);
+    }
+
+    vector<const uint8_t*> unknown;
+    vector<const char*> values;
+    const size_t n = parse_binary(f, bin_file, unknown, values);
+    if (n) {
+	for (size_t j=0; j<_numOfAttributes; j++) {
+	    _col[j].assign(values[j], unknown[j], n);
+	}
+    }
+    _numOfInstance = n;
+
+    fprintf( stdout, "(I) Read %lu attributes, %lu instances.\n", 
+	    (unsigned long)_numOfAttributes, (unsigned long)_numOfInstance );
+    return *this;
+}
+
+Dataset&
+Dataset::read_arff_cached( const char* arff_file, const size_t nThread )
+{
+    struct stat st;
+    if (stat(arff_file, &st) != 0) {
+	fprintf(stderr, "(E) Opening file %s failed.\n", arff_file);
+	exit(1);
+    }
+    const string bin_file = string(arff_file) + ".bin";
+
+    {
+	MappedFile f;
+	BinHeader h;
+	if (f.open(bin_file.c_str()) == 0 && bin_header(f, h) == 0
+		&& bin_cache_of(h, st)) {
+	    f.close();
+	    return open_binary(bin_file.c_str());
+	}
+    }
+
+    read_arff(arff_file, nThread);
+    // Write aside and rename, so a reader never sees half a cache.
+    const string tmp_file = bin_file + ".tmp";
+    if (write_binary(tmp_file.c_str(), &st) != 0
+	    || rename(tmp_file.c_str(), bin_file.c_str()) != 0) {
+	fprintf(stderr, "(W) Can not write cache %s.\n", bin_file.c_str());
+	remove(tmp_file.c_str());
+    } else {
+	fprintf( stdout, "(I) Cached to %s.\n", bin_file.c_str() );
+    }
+    return *this;
+}
+
+/* ---- Instance streams ---- */
+
+#define ARFF_STREAM_BLOCK (1<<20)
+
+void
+ArffStream::open( const char* arff_file )
+{
+    close();
+    _fp = fopen(arff_file, "rb");
+    if (!_fp) {
+	fprintf(stderr, "(E) Opening file %s failed.\n", arff_file);
+	exit(1);
+    }
+    _buf.resize(ARFF_STREAM_BLOCK);
+    _begin = _end = 0;
+    _eof = 0;
+
+    _schema.init();
+    vector<char> buf;
+    const char* line;
+    const char* eol;
+    while (next_line(line, eol)) {
+	buf.assign(line, eol);
+	buf.push_back('\0');
+	if (_schema.parse_header_line(&buf[0])) break;
+    }
+    _schema.end_header();
+}
+
+void
+ArffStream::close()
+{
+    if (_fp) fclose(_fp);
+    _fp = NULL;
+}
+
+bool
+ArffStream::next_line(const char*& line, const char*& eol)
+{
+    while (1) {
+	char* p = &_buf[0];
+	char* nl = (char*)memchr(p + _begin, '\n', _end - _begin);
+	if (nl) {
+	    line = p + _begin;
+	    eol = nl;
+	    _begin = nl - p + 1;
+	    return 1;
+	}
+	if (_eof) {
+	    if (_begin == _end) return 0;
+	    // The last line has no newline: give it one.
+	    if (_end == _buf.size()) {
+		_buf.resize(_buf.size() + 1);
+		p = &_buf[0];
+	    }
+	    p[_end] = '\n';
+	    line = p + _begin;
+	    eol = p + _end;
+	    _begin = _end = _end + 1;
+	    return 1;
+	}
+	// Move the partial line to the front, grow the buffer if the line 
+	// is longer than it, and read more.
+	memmove(p, p + _begin, _end - _begin);
+	_end -= _begin;
+	_begin = 0;
+	if (_end == _buf.size()) {
+	    _buf.resize(_buf.size() * 2);
+	    p = &_buf[0];
+	}
+	size_t n = fread(p + _end, 1, _buf.size() - _end, _fp);
+	if (n == 0) _eof = 1;
+	_end += n;
+    }
+}
+
+bool
+ArffStream::next(Instance& inst)
+{
+    const char* line;
+    const char* eol;
+    while (next_line(line, eol)) {
+	if (_schema.parse_line(line, eol, inst)) return 1;
+    }
+    return 0;
+}
+
+void
+BinaryStream::open( const char* bin_file )
+{
+    if (_f.open(bin_file) != 0) {
+	fprintf(stderr, "(E) Opening file %s failed.\n", bin_file);
+	exit(1);
+    }
+    _nInst = _schema.parse_binary(_f, bin_file, _unknown, _values);
+    _i = 0;
+}
+
+bool
+BinaryStream::next(Instance& inst)
+{
+    if (_i >= _nInst) return 0;
+    const size_t nAtt = _schema.num_of_att();
+    inst.resize(nAtt);
+    for (size_t j=0; j<nAtt; j++) {
+	Attribute& att = inst[j];
+	att.unknown = _unknown[j][_i];
+	if (_schema.get_att_desc(j).get_type() == ATT_TYPE_NUMERIC) {
+	    memcpy(&att.value.num, _values[j] + _i*sizeof(NumericType), 
+		    sizeof(NumericType));
+	} else {
+	    NominalCode code;
+	    memcpy(&code, _values[j] + _i*sizeof(NominalCode), sizeof(code));
+	    att.value.nom = code;
+	}
+    }
+    _i ++;
+    return 1;
+}
@@ -25,6 +25,7 @@
 #define __DATASET_H__
 
 #include "common.h"
+#include "mappedfile.h"
 
 using namespace std;
 
@@ -64,6 +65,27 @@ class AttDesc {
 	char	name[64];
 	AttType	type;
 	vector<string> * possibleValues; 
+	/**
+	 * Open addressing hash index on possibleValues.
+	 *
+	 * Each slot is 0 if empty, or the index of a value plus 1. The 
+	 *   size is a power of 2, at least twice the number of values.
+	 *   It is built by index_values().
+	 */
+	vector<uint32_t> valueIndex;
+	/** The number of values valueIndex was built on. */
+	size_t	nIndexed;
+
+	/** Hash of a (not null terminated) string. FNV-1a. */
+	static uint32_t hash(const char* str, const size_t len)
+	{
+	    uint32_t h = 2166136261u;
+	    for (size_t i=0; i<len; i++) {
+		h ^= (unsigned char)str[i];
+		h *= 16777619u;
+	    }
+	    return h;
+	}
     public:
 	// ---- set and get ----
 	AttDesc& set_name(const char* name);
@@ -81,10 +103,16 @@ class AttDesc {
 	 * E.g. {"a", "b", "c"}, map("c") will give 2, map(2) will give
 	 *   "c"
 	 *
+	 * The string to index direction is O(1) once the values are 
+	 *   indexed (index_values()), or a linear scan otherwise.
+	 *
 	 * NOTE: It requires the AttDesc to be nominal.
 	 */
-	size_t map(const string str) const;
+	size_t map(const string& str) const;
 	size_t map(const char* str) const;
+	/** Same as map(const char*), for a string that is not null 
+	 *   terminated, e.g. a token inside a mapped file. */
+	size_t map(const char* str, const size_t len) const;
 	string map(const size_t index) const;
 
 	/**
@@ -97,6 +125,16 @@ class AttDesc {
 	vector<string> & possible_value_vector();
 	const vector<string> & possible_value_vector() const;
 
+	/**
+	 * \brief Build the hash index used by map(const char*, size_t).
+	 *
+	 * Call it after the possible values are filled in. If values are 
+	 *   added or removed afterwards through possible_value_vector(), 
+	 *   map() falls back to a linear scan until it is called again. 
+	 *   Values changed in place need it called again.
+	 */
+	AttDesc& index_values();
+
 
 	// ---- c'tor and d'tor ----
 	/**
@@ -166,9 +204,168 @@ class Attribute {
 /** \brief Instance type.
  *
  * Instance is described by an array of Attributes.
+ *
+ * It is the stand-alone form of a row, e.g. one built by hand to be 
+ *   classified. Rows stored in a Dataset are columnar and are accessed 
+ *   through InstanceRef instead.
+ *
+ * \sa InstanceRef
  */
 typedef vector<Attribute> Instance;
 
+/** 
+ * \brief Stored nominal value type.
+ *
+ * The dense index of a nominal value in AttDesc::possible_value_vector(),
+ *   as stored in a Column. It is widened to NominalType when read out 
+ *   as an Attribute.
+ */
+typedef uint32_t NominalCode;
+
+/**
+ * \brief A column of attribute values.
+ *
+ * One column stores the j-th attribute of every instance of a Dataset 
+ *   in a contiguous typed array: doubles for a numeric attribute, 
+ *   nominal codes for a nominal one. Whether a value is unknown is kept 
+ *   in a separate mask, so that a pass over the values does not have 
+ *   to touch anything else.
+ *
+ * A column can also be sparse, e.g. when read from a sparse ARFF file. 
+ *   Then only the values that are not the default one (0 if numeric, 
+ *   the first possible value if nominal) are stored, with their rows 
+ *   in row(), and num(), nom() and unknown() are parallel to row().
+ *
+ * The value of an unknown cell is 0 and should not be used.
+ *
+ * \sa Dataset, AttDesc
+ */
+class Column {
+    private:
+	AttType			_type;
+	bool			_sparse;
+	size_t			_nRow; ///< Number of values, stored or not.
+	vector<uint32_t>	_row; ///< Row of each stored value, if sparse.
+	vector<NumericType>	_num; ///< Values, if numeric.
+	vector<NominalCode>	_nom; ///< Value indecs, if nominal.
+	vector<uint8_t>		_unknown; ///< 1 if the value is unknown.
+
+	/** If att is the value a sparse column does not store. */
+	bool is_default(const Attribute& att) const
+	{
+	    if (att.unknown) return 0;
+	    if (_type == ATT_TYPE_NUMERIC) return att.value.num == 0;
+	    return att.value.nom == 0;
+	}
+    public:
+	AttType type() const {return _type;}
+	/** Number of values (instances) in this column. */
+	size_t size() const {return _nRow;}
+	/** If only the values other than the default one are stored. */
+	bool sparse() const {return _sparse;}
+
+	/** The row of each stored value. Empty if the column is dense. */
+	const vector<uint32_t>& row() const {return _row;}
+	/** The numeric value array. Empty if the column is nominal. */
+	const vector<NumericType>& num() const {return _num;}
+	/** The nominal code array. Empty if the column is numeric. */
+	const vector<NominalCode>& nom() const {return _nom;}
+	/** The unknown value mask. */
+	const vector<uint8_t>& unknown() const {return _unknown;}
+
+	/** Append a value to the end of the column. */
+	void push_back(const Attribute& att)
+	{
+	    if (_sparse) {
+		if (is_default(att)) {
+		    _nRow ++;
+		    return;
+		}
+		_row.push_back(_nRow);
+	    }
+	    _unknown.push_back(att.unknown);
+	    if (_type == ATT_TYPE_NUMERIC) {
+		_num.push_back(att.unknown ? 0 : att.value.num);
+	    } else {
+		_nom.push_back(att.unknown ? 0 : NominalCode(att.value.nom));
+	    }
+	    _nRow ++;
+	}
+
+	/** Get the i-th value as an Attribute. */
+	Attribute operator[] (const size_t i) const
+	{
+	    assert(i < size());
+	    Attribute att;
+	    size_t k = i;
+	    if (_sparse) {
+		// Binary search the stored rows.
+		vector<uint32_t>::const_iterator it = 
+		    lower_bound(_row.begin(), _row.end(), (uint32_t)i);
+		if (it == _row.end() || *it != i) return att; // the default
+		k = it - _row.begin();
+	    }
+	    att.unknown = _unknown[k];
+	    if (_type == ATT_TYPE_NUMERIC) {
+		att.value.num = _num[k];
+	    } else {
+		att.value.nom = _nom[k];
+	    }
+	    return att;
+	}
+
+	void reserve(const size_t n);
+	void clear();
+	/** Append all the values of another column of the same type. */
+	Column& append(const Column& col);
+	/**
+	 * \brief Replace the content by n values copied from raw arrays.
+	 *
+	 * values points to n NumericType if the column is numeric, or to 
+	 *   n NominalCode if nominal. unknown points to n mask bytes.
+	 *   The column becomes dense.
+	 */
+	Column& assign(const void* values, const uint8_t* unknown, const size_t n);
+	/** Store every value, i.e. make a sparse column dense. */
+	Column& densify();
+
+	Column(const AttType type = ATT_TYPE_NONE, const bool sparse = 0)
+	    : _type(type), _sparse(sparse), _nRow(0) {}
+};
+
+class Dataset;
+struct stat;
+
+/**
+ * \brief A read-only reference to a row.
+ *
+ * It either refers to the i-th row of a Dataset, which is gathered from 
+ *   the columns on access, or to a stand-alone Instance. So that 
+ *   inst[j] is the j-th attribute either way, and code taking an 
+ *   InstanceRef accepts both.
+ *
+ * It is only valid as long as the referred Dataset or Instance is.
+ *
+ * \sa Dataset::operator[](), Instance
+ */
+class InstanceRef {
+    private:
+	const Dataset*	_ds;
+	size_t		_row;
+	const Instance*	_inst;
+    public:
+	InstanceRef(const Dataset& ds, const size_t row)
+	    : _ds(&ds), _row(row), _inst(NULL) {}
+	/** Refer to a stand-alone instance. Implicit on purpose. */
+	InstanceRef(const Instance& inst)
+	    : _ds(NULL), _row(0), _inst(&inst) {}
+
+	/** Get the j-th attribute of the row. */
+	inline Attribute operator[] (const size_t j) const;
+	/** Get the number of attributes in the row. */
+	inline size_t size() const;
+};
+
 /**
  * \brief The Dataset class.
  *
@@ -177,7 +374,7 @@ typedef vector<Attribute> Instance;
  *     which describes each column of Attribute in the corresponding 
  *     instances, for example, the type of the attribute, the possible 
  *     values of the attribute (if it's a nominal one).
- *   (2) a table of instances. 
+ *   (2) a table of instances, stored column by column (Column).
  *
  * It supports read in an arff file, having only nominal and numeric 
  *   attributes.
@@ -187,7 +384,7 @@ typedef vector<Attribute> Instance;
  *   classes which can take Dataset as an argument, so that the Dataset 
  *   type is acutally made reusable.
  *
- * \sa Instance, Attribute, AttDesc
+ * \sa Instance, InstanceRef, Column, Attribute, AttDesc
  */
 class Dataset {
 
@@ -195,19 +392,183 @@ class Dataset {
 	size_t		_numOfInstance;
 	size_t		_numOfAttributes;
 
-	vector<Instance> _inst; ///< the instances in this dataset.
+	vector<Column>	_col; ///< the instances in this dataset, by column.
 	vector<AttDesc>	_attDesc; ///< describe the instance structure.
 
 	void init(); ///< A private init function for ctor use
 
+	/**
+	 * \brief Parse the lines of the data section in [begin, end).
+	 *
+	 * Each line is tokenized in place and appended to col, which must 
+	 *   have one column for each AttDesc. The last line need not end 
+	 *   with a newline. It only reads the AttDesc, so several chunks 
+	 *   may be parsed at the same time.
+	 *
+	 * \return The number of instances appended.
+	 */
+	size_t parse_data(const char* begin, const char* end, 
+		vector<Column>& col) const;
+
+	/**
+	 * \brief Parse one line of the header (null terminated, may be 
+	 *   modified), adding the AttDesc it describes.
+	 *
+	 * \return 1 if it is the "@data" line, 0 otherwise.
+	 */
+	int parse_header_line(char* buf);
+
+	/**
+	 * \brief Make the (empty) columns once all AttDesc are read.
+	 *
+	 * \param sparse If the columns are to be sparse.
+	 */
+	void end_header(const bool sparse = 0);
+
+	/** \brief Parse the token [result, result+len) as the i-th attribute. */
+	void parse_value(const size_t i, const char* result, const size_t len, 
+		Attribute& att) const;
+
+	/** \brief parse_line() for a sparse line: "{index value, ...}". */
+	size_t parse_sparse_line(const char* line, const char* eol, 
+		Instance& inst) const;
+
+	/**
+	 * \brief Read the header and descriptors of a mapped binary file.
+	 *
+	 * The columns are left empty. unknown[j] and values[j] are set to 
+	 *   the j-th column's mask and value array inside the mapping.
+	 *
+	 * \return The number of instances in the file.
+	 */
+	size_t parse_binary( const MappedFile& f, const char* bin_file, 
+		vector<const uint8_t*>& unknown, vector<const char*>& values );
+
+	/**
+	 * \brief save_binary(), but return -1 if the file cannot be 
+	 *   written, and 0 if it is.
+	 *
+	 * What is written of the file is left on a failure.
+	 */
+	int write_binary( const char* bin_file, const struct stat* src ) const;
+
+	friend class ArffStream;
+	friend class BinaryStream;
+
+	/** 
+	 * \brief Parse the data section [begin, end) on nThread threads.
+	 *
+	 * The section is cut into nThread chunks on newline boundaries, each 
+	 *   parsed into its own columns, which are then appended in file 
+	 *   order.
+	 */
+	void parse_data_parallel(const char* begin, const char* end, 
+		const size_t nThread);
+
     public:
 	/** 
 	 * \brief Read from arff file.
+	 *
+	 * The file is mapped into memory (MappedFile) and the data section 
+	 *   is tokenized in place, so there is no limit on the line length.
+	 *
+	 * If the first instance is a sparse one, the columns are sparse 
+	 *   (see Column), except those which would store more than half 
+	 *   of their values anyway.
+	 *
+	 * \param arff_file The file name.
+	 * \param nThread Number of threads parsing the data section. 0 for 
+	 *   one per processor. The result is the same for any number.
+	 */
+	Dataset& read_arff( const char* arff_file, const size_t nThread = 1 );
+
+	/** \brief Init from ARFF file. \sa read_arff() */
+	Dataset(const char* arff_file, const size_t nThread = 1);
+
+	/**
+	 * \brief Parse one data line [line, eol) into inst.
+	 *
+	 * The line is either dense, with every value in order separated by 
+	 *   commas, or sparse as in WEKA: "{index value, ...}" where the 
+	 *   values not listed are 0 if numeric, or the first possible value 
+	 *   if nominal.
+	 *
+	 * The character at eol must not be part of a number, e.g. a newline.
+	 *   inst is resized to num_of_att().
+	 *
+	 * \return 0 if the line is blank, 1 otherwise.
+	 */
+	size_t parse_line(const char* line, const char* eol, Instance& inst) const;
+
+	/** \brief An empty dataset, e.g. to open_binary() into. */
+	Dataset() {init();}
+
+	/**
+	 * \brief Save to a binary dataset file.
+	 *
+	 * The file holds the attribute descriptors (names, types and 
+	 *   possible values) followed by the columns, as they are in memory.
+	 *   It can only be read on a machine of the same byte order.
+	 *
+	 * \param bin_file The file name.
+	 * \param src The stat() of the ARFF file it is cached from, whose 
+	 *   size, modification time, device and inode read_arff_cached() 
+	 *   checks. NULL if not a cache.
+	 *
+	 * Exits if the file cannot be written, removing it.
 	 */
-	Dataset& read_arff( const char* arff_file );
+	const Dataset& save_binary( const char* bin_file, 
+		const struct stat* src = NULL ) const;
 
-	/** \brief Init from ARFF file. */
-	Dataset(const char* arff_file);
+	/**
+	 * \brief Save to an arff file, which read_arff() reads back.
+	 *
+	 * The numbers are written with all their digits. The nominal 
+	 *   values must not contain spaces nor commas.
+	 */
+	const Dataset& save_arff( const char* arff_file ) const;
+
+	/**
+	 * \brief Write the attribute descriptors, as in save_binary().
+	 *
+	 * Each descriptor is padded to 8 bytes, from the position in fp. 
+	 *   So other binary files (e.g. a CompiledModel) can hold a schema.
+	 *   A write error is left to be checked by ferror(fp).
+	 */
+	void save_schema( FILE* fp, const char* bin_file ) const;
+
+	/**
+	 * \brief Read nAtt descriptors written by save_schema().
+	 *
+	 * The dataset is reset to them, without any instance.
+	 *
+	 * \param begin Where the descriptors start, 8 byte aligned.
+	 * \param size The bytes available from begin.
+	 * \return The bytes read, a multiple of 8.
+	 */
+	size_t open_schema( const char* begin, const size_t size, 
+		const size_t nAtt, const char* bin_file );
+
+	/**
+	 * \brief Read from a binary dataset file written by save_binary().
+	 *
+	 * The file is mapped and every column is copied out with a single 
+	 *   memcpy: there is nothing to parse but the descriptors. The 
+	 *   nominal codes are checked against the possible values, exiting 
+	 *   if the file is corrupted.
+	 */
+	Dataset& open_binary( const char* bin_file );
+
+	/**
+	 * \brief Read from arff file, through a binary cache beside it.
+	 *
+	 * The cache is arff_file with ".bin" appended. It is used if it was 
+	 *   made from a file of the same size, modification time (to the 
+	 *   nanosecond, where the system keeps it), device and inode as 
+	 *   arff_file. Otherwise the ARFF file is read (read_arff()) and the 
+	 *   cache (re)written.
+	 */
+	Dataset& read_arff_cached( const char* arff_file, const size_t nThread = 1 );
 
 	/** \brief Get the number of instances in this dataset. */
 	const size_t num_of_inst() const {return _numOfInstance;}
@@ -218,25 +579,46 @@ class Dataset {
 	/**
 	 * \brief Get a reference to the i-th instance.
 	 *
-	 * By this operator and operator[] of class Instance, 
+	 * By this operator and InstanceRef::operator[], 
 	 *   dataset[i][j] will return:
 	 *   the j-th attribute in the i-th instance
 	 *   in the dataset.
 	 *
-	 * \sa class Instance
+	 * \sa class InstanceRef
 	 */
-	Instance & operator[] ( const size_t index )
+	InstanceRef operator[] ( const size_t index ) const 
 	{
 	    assert(index < num_of_inst());
-	    return _inst[index];
+	    return InstanceRef(*this, index);
 	}
 
-	const Instance & operator[] ( const size_t index ) const 
+	/**
+	 * \brief Get the j-th column.
+	 *
+	 * Algorithms that go through all the instances for an attribute 
+	 *   should walk the column rather than dataset[i][j].
+	 */
+	const Column & column(size_t index) const
 	{
-	    assert(index < num_of_inst());
-	    return _inst[index];
+	    assert(index < num_of_att());
+	    return _col[index];
 	}
 
+	/**
+	 * \brief Append an attribute to the schema of an empty dataset.
+	 *
+	 * So a dataset can be made by a program rather than read. The 
+	 *   possible values of a nominal one are indexed (index_values()).
+	 */
+	Dataset& add_att(const AttDesc& desc);
+
+	/**
+	 * \brief Append an instance to the end of the dataset.
+	 *
+	 * The instance must have one attribute for each AttDesc.
+	 */
+	Dataset& push_back(const Instance& inst);
+
 	/** Return a reference to the attribute descriptor vectors (attDesc) */
 	AttDesc & get_att_desc(size_t index)
 	{
@@ -252,4 +634,102 @@ class Dataset {
 	}
 };
 
+/**
+ * \brief A source of instances, read one at a time.
+ *
+ * It is used to go through a dataset too large to be loaded, e.g. to 
+ *   train on it. The schema is a Dataset with the attribute descriptors 
+ *   and no instance, to which a Classifier can be bound.
+ *
+ * \sa ArffStream, BinaryStream
+ */
+class InstanceStream {
+    public:
+	/** The attribute descriptors of the instances. */
+	virtual const Dataset& schema() const = 0;
+	/**
+	 * \brief Read the next instance into inst.
+	 *
+	 * \return 0 at the end of the stream, 1 otherwise.
+	 */
+	virtual bool next(Instance& inst) = 0;
+	virtual ~InstanceStream() {}
+};
+
+/**
+ * \brief Instances read one by one from an arff file.
+ *
+ * The file is read block by block, so the memory used is one block 
+ *   (or the longest line) whatever the size of the file.
+ */
+class ArffStream : public InstanceStream {
+    private:
+	FILE*		_fp;
+	Dataset		_schema;
+	vector<char>	_buf;
+	size_t		_begin; ///< Start of the unread part of _buf.
+	size_t		_end; ///< End of the valid part of _buf.
+	bool		_eof;
+
+	/** Get the next line [line, eol), eol pointing to a newline. */
+	bool next_line(const char*& line, const char*& eol);
+
+	// Not copyable.
+	ArffStream(const ArffStream&);
+	ArffStream& operator=(const ArffStream&);
+    public:
+	/** Open the file and read the header. */
+	void open( const char* arff_file );
+	void close();
+
+	const Dataset& schema() const {return _schema;}
+	bool next(Instance& inst);
+
+	ArffStream( const char* arff_file ) : _fp(NULL) {open(arff_file);}
+	~ArffStream() {close();}
+};
+
+/**
+ * \brief Instances read one by one from a binary dataset file.
+ *
+ * The file is mapped, and each instance is gathered from the columns 
+ *   in the mapping.
+ *
+ * \sa Dataset::save_binary()
+ */
+class BinaryStream : public InstanceStream {
+    private:
+	MappedFile		_f;
+	Dataset			_schema;
+	vector<const uint8_t*>	_unknown;
+	vector<const char*>	_values;
+	size_t			_nInst;
+	size_t			_i; ///< The next instance.
+
+	// Not copyable.
+	BinaryStream(const BinaryStream&);
+	BinaryStream& operator=(const BinaryStream&);
+    public:
+	void open( const char* bin_file );
+
+	const Dataset& schema() const {return _schema;}
+	bool next(Instance& inst);
+
+	BinaryStream( const char* bin_file ) {open(bin_file);}
+};
+
+inline Attribute
+InstanceRef::operator[] (const size_t j) const
+{
+    if (_inst) return (*_inst)[j];
+    return _ds->column(j)[_row];
+}
+
+inline size_t
+InstanceRef::size() const
+{
+    if (_inst) return _inst->size();
+    return _ds->num_of_att();
+}
+
 #endif
@@ -0,0 +1,263 @@
+/**
+ * \file discretizer.cpp
+ * \author Kefei Lu
+ * \brief Implementation of Discretizer.
+ * \sa discretizer.h
+ */
+
+#include "discretizer.h"
+#include "parallel.h"
+using namespace std;
+
+/** A value of the training set and its class. */
+typedef pair<double, int32_t> ClassValue;
+
+/**
+ * Merge the sorted values into blocks, which are never cut: equal values,
+ * then, if nGroup is not 0, runs of them of about 1/nGroup of the values.
+ *
+ * \param lo,hi The smallest and largest value of each block.
+ * \param count Element [b*nClass+c]: the number of values of class c in
+ *   block b.
+ */
+static void
+make_blocks(const vector<ClassValue>& v, const size_t nClass,
+	const size_t nGroup, vector<double>& lo, vector<double>& hi,
+	vector<size_t>& count)
+{
+    lo.clear();
+    hi.clear();
+    count.clear();
+    const size_t n = v.size();
+    bool open = 0;
+    for (size_t i=0;i<n;i++) {
+	if (!open) {
+	    lo.push_back(v[i].first);
+	    hi.push_back(v[i].first);
+	    count.resize(count.size() + nClass, 0);
+	    open = 1;
+	}
+	hi.back() = v[i].first;
+	count[count.size() - nClass + v[i].second] ++;
+	// Close the block at the end of a run of equal values, once it
+	// holds its share.
+	if (i+1 < n && v[i+1].first == v[i].first) continue;
+	if (nGroup && (i+1) * nGroup < lo.size() * n) continue;
+	open = 0;
+    }
+}
+
+/** The cut point between two blocks. */
+static double
+cut_between(const double hi, const double lo)
+{
+    const double mid = hi + (lo - hi) / 2;
+    return mid < lo ? mid : hi;
+}
+
+/** Entropy, in bits, of the class counts; k is set to the number of
+ * classes present. */
+static double
+entropy(const size_t* count, const size_t nClass, const size_t n, size_t& k)
+{
+    double e = 0;
+    k = 0;
+    for (size_t c=0;c<nClass;c++) {
+	if (!count[c]) continue;
+	const double p = (double)count[c] / n;
+	e -= p * log(p);
+	k ++;
+    }
+    return e / log(2.0);
+}
+
+/**
+ * Split blocks [begin, end) at the boundary of least class entropy, and
+ * recurse on both sides, as long as the split passes the MDL criterion.
+ *
+ * \param prefix Element [b*nClass+c]: the number of values of class c
+ *   in the blocks before b.
+ * \param cutAt Where the boundaries split are appended, in order: b for
+ *   the one between blocks b-1 and b.
+ */
+static void
+mdl_split(const vector<size_t>& prefix, const size_t nClass,
+	const size_t begin, const size_t end, vector<size_t>& cutAt)
+{
+    if (end - begin < 2) return;
+    vector<size_t> s(nClass), l(nClass), r(nClass);
+    size_t n = 0;
+    for (size_t c=0;c<nClass;c++) {
+	s[c] = prefix[end*nClass+c] - prefix[begin*nClass+c];
+	n += s[c];
+    }
+    size_t kS, kL, kR;
+    const double eS = entropy(&s[0], nClass, n, kS);
+    if (kS < 2) return;
+
+    size_t best = 0;
+    double bestE = HUGE_VAL;
+    for (size_t b=begin+1;b<end;b++) {
+	size_t nL = 0;
+	for (size_t c=0;c<nClass;c++) {
+	    l[c] = prefix[b*nClass+c] - prefix[begin*nClass+c];
+	    r[c] = s[c] - l[c];
+	    nL += l[c];
+	}
+	const double e = (nL * entropy(&l[0], nClass, nL, kL)
+		+ (n-nL) * entropy(&r[0], nClass, n-nL, kR)) / n;
+	if (e < bestE) {
+	    bestE = e;
+	    best = b;
+	}
+    }
+
+    size_t nL = 0;
+    for (size_t c=0;c<nClass;c++) {
+	l[c] = prefix[best*nClass+c] - prefix[begin*nClass+c];
+	r[c] = s[c] - l[c];
+	nL += l[c];
+    }
+    const double eL = entropy(&l[0], nClass, nL, kL);
+    const double eR = entropy(&r[0], nClass, n-nL, kR);
+    const double gain = eS - bestE;
+    const double delta = log(pow(3.0, (double)kS) - 2) / log(2.0)
+	- (kS*eS - kL*eL - kR*eR);
+    if (gain <= (log((double)(n-1)) / log(2.0) + delta) / n) return;
+
+    mdl_split(prefix, nClass, begin, best, cutAt);
+    cutAt.push_back(best);
+    mdl_split(prefix, nClass, best, end, cutAt);
+}
+
+/** Everything the discretizing threads share. */
+struct DiscretizeJobs {
+    const Dataset*		ds;
+    Discretizer::Method		method;
+    size_t			nBin;
+    size_t			nCandidate;
+    /** The attributes, one per job. */
+    vector<size_t>		att;
+    /** The class of each row, -1 for those not to learn from. */
+    vector<int32_t>		rowClass;
+    /** The number of rows of each class to learn from. */
+    vector<size_t>		nRowOfClass;
+    /** Where the cut points go. */
+    vector< vector<double> >*	cut;
+};
+
+static void
+discretize_job(const size_t i, void* arg)
+{
+    const DiscretizeJobs* jobs = (const DiscretizeJobs*)arg;
+    const size_t a = jobs->att[i];
+    const size_t nClass = jobs->nRowOfClass.size();
+    const Column& col = jobs->ds->column(a);
+    const int32_t* cls = &jobs->rowClass[0];
+    const uint8_t* unknown = col.unknown().empty() ? NULL : &col.unknown()[0];
+    const NumericType* value = col.num().empty() ? NULL : &col.num()[0];
+
+    vector<ClassValue> v;
+    if (col.sparse()) {
+	vector<size_t> nStored(nClass, 0);
+	for (size_t k=0;k<col.row().size();k++) {
+	    const int32_t c = cls[col.row()[k]];
+	    if (c < 0) continue;
+	    nStored[c] ++;
+	    if (unknown[k]) continue;
+	    v.push_back(ClassValue(value[k], c));
+	}
+	// The rest are 0.
+	for (size_t c=0;c<nClass;c++) {
+	    v.resize(v.size() + jobs->nRowOfClass[c] - nStored[c],
+		    ClassValue(0, c));
+	}
+    } else {
+	const size_t nRow = jobs->rowClass.size();
+	for (size_t r=0;r<nRow;r++) {
+	    const int32_t c = cls[r];
+	    if (c < 0) continue;
+	    if (unknown[r]) continue;
+	    v.push_back(ClassValue(value[r], c));
+	}
+    }
+    sort(v.begin(), v.end());
+
+    vector<double> lo, hi;
+    vector<size_t> count;
+    vector<double>& cut = (*jobs->cut)[a];
+    cut.clear();
+    if (jobs->method == Discretizer::DISCRETIZE_EQUAL_FREQUENCY) {
+	make_blocks(v, nClass, jobs->nBin, lo, hi, count);
+	for (size_t b=1;b<lo.size();b++) {
+	    cut.push_back(cut_between(hi[b-1], lo[b]));
+	}
+	return;
+    }
+
+    make_blocks(v, nClass, jobs->nCandidate, lo, hi, count);
+    const size_t nBlock = lo.size();
+    vector<size_t> prefix((nBlock+1)*nClass, 0);
+    for (size_t b=0;b<nBlock;b++) {
+	for (size_t c=0;c<nClass;c++) {
+	    prefix[(b+1)*nClass+c] = prefix[b*nClass+c] + count[b*nClass+c];
+	}
+    }
+    vector<size_t> cutAt;
+    mdl_split(prefix, nClass, 0, nBlock, cutAt);
+    for (size_t k=0;k<cutAt.size();k++) {
+	cut.push_back(cut_between(hi[cutAt[k]-1], lo[cutAt[k]]));
+    }
+}
+
+void
+Discretizer::
+fit(const Dataset& ds, const vector<size_t>& rows, const size_t classIndex,
+	const vector<size_t>& att, const size_t nThread)
+{
+    fprintf(stdout, "(I) Discretizer: Discretizing %d attributes (%s)...\n",
+	    (int)att.size(),
+	    method() == DISCRETIZE_MDL ? "MDL" : "equal frequency");
+    if (method() == DISCRETIZE_EQUAL_FREQUENCY && n_bin() == 0) {
+	fprintf(stderr, "(E) Discretizer: The number of bins is 0.\n");
+	exit(1);
+    }
+    const size_t nAtt = ds.num_of_att();
+    const size_t nClass =
+	ds.get_att_desc(classIndex).possible_value_vector().size();
+    _binned.assign(nAtt, 0);
+    _cut.assign(nAtt, vector<double>());
+
+    DiscretizeJobs jobs;
+    jobs.ds = &ds;
+    jobs.method = method();
+    jobs.nBin = n_bin();
+    jobs.nCandidate = n_candidate();
+    jobs.cut = &_cut;
+    jobs.rowClass.assign(ds.num_of_inst(), -1);
+    jobs.nRowOfClass.assign(nClass, 0);
+    const Column& klass = ds.column(classIndex);
+    for (size_t j=0;j<rows.size();j++) {
+	const Attribute c = klass[rows[j]];
+	if (c.unknown) continue;
+	jobs.rowClass[rows[j]] = c.value.nom;
+	jobs.nRowOfClass[c.value.nom] ++;
+    }
+    for (size_t i=0;i<att.size();i++) {
+	const size_t a = att[i];
+	if (a == classIndex) continue;
+	if (ds.get_att_desc(a).get_type() != ATT_TYPE_NUMERIC) continue;
+	jobs.att.push_back(a);
+	_binned[a] = 1;
+    }
+    if (jobs.rowClass.empty()) return;
+    run_parallel(discretize_job, &jobs, jobs.att.size(), nThread);
+}
+
+void
+Discretizer::
+clear(void)
+{
+    _binned.clear();
+    _cut.clear();
+}
@@ -0,0 +1,103 @@
+/**
+ * \file discretizer.h
+ * \author Kefei Lu
+ * \brief Supervised discretization of numeric attributes into intervals.
+ * \sa discretizer.cpp
+ */
+
+#ifndef __DISCRETIZER_H__
+#define __DISCRETIZER_H__
+
+#include "common.h"
+#include "dataset.h"
+
+/**
+ * \brief Cuts the numeric attributes of a dataset into intervals (bins).
+ *
+ * The cut points are learnt from a training set, either as bins of the
+ *   same number of instances (equal frequency), or by recursive minimal
+ *   entropy splits, kept while they pass the MDL criterion of Fayyad and
+ *   Irani (1993). MDL only looks at the boundaries of n_candidate()
+ *   equal frequency bins, which bounds its cost on long columns.
+ *
+ * A value of a discretized attribute is then the nominal index of its
+ *   bin: bin i holds the values in (cut[i-1], cut[i]].
+ *
+ * \sa NaiveBayesClassifierDiscrete
+ */
+class Discretizer {
+    public:
+	enum Method {
+	    DISCRETIZE_EQUAL_FREQUENCY = 0,
+	    DISCRETIZE_MDL
+	};
+    private:
+	Method		_method;
+	size_t		_nBin;
+	size_t		_nCandidate;
+	/** Element [a]: if attribute a is discretized. */
+	vector<uint8_t>	_binned;
+	/** Element [a]: the cut points of attribute a, ascending. */
+	vector< vector<double> >	_cut;
+    public:
+	/** The method, DISCRETIZE_MDL by default. */
+	Method& method(void) {return _method;}
+	const Method& method(void) const {return _method;}
+	/** The number of bins of DISCRETIZE_EQUAL_FREQUENCY, 10 by default. */
+	size_t& n_bin(void) {return _nBin;}
+	const size_t& n_bin(void) const {return _nBin;}
+	/** The number of equal frequency bins whose boundaries are the
+	 * candidate cuts of DISCRETIZE_MDL, 256 by default. 0 takes every
+	 * boundary between two distinct values. */
+	size_t& n_candidate(void) {return _nCandidate;}
+	const size_t& n_candidate(void) const {return _nCandidate;}
+
+	/**
+	 * \brief Learn the cut points of some numeric attributes.
+	 *
+	 * \param ds The dataset.
+	 * \param rows The rows of ds to learn from. Those of unknown class
+	 *   and the unknown values are left out.
+	 * \param classIndex The class attribute, nominal.
+	 * \param att The attributes to discretize, numeric ones. The others
+	 *   are left as they are.
+	 * \param nThread The number of threads, one attribute per job (see
+	 *   run_parallel()).
+	 */
+	void fit(const Dataset& ds, const vector<size_t>& rows,
+		const size_t classIndex, const vector<size_t>& att,
+		const size_t nThread = 1);
+	/** Forget the cut points. */
+	void clear(void);
+
+	/** If attribute a is discretized. */
+	bool binned(const size_t a) const {return a < _binned.size() && _binned[a];}
+	/** The cut points of a discretized attribute a, ascending. */
+	const vector<double>& cut(const size_t a) const {return _cut.at(a);}
+	/** The number of bins of a discretized attribute a. */
+	size_t num_of_bin(const size_t a) const {return cut(a).size() + 1;}
+	/** The bin of value x of a discretized attribute a. */
+	size_t bin(const size_t a, const double x) const
+	{
+	    const vector<double>& c = cut(a);
+	    return c.empty() ? 0 : bin(&c[0], c.size(), x);
+	}
+	/**
+	 * The bin of x given nCut ascending cut points: the number of
+	 * them below x.
+	 *
+	 * A plain count without branch, as there are few cuts.
+	 */
+	static size_t bin(const double* cut, const size_t nCut, const double x)
+	{
+	    size_t b = 0;
+	    for (size_t i=0;i<nCut;i++) {
+		b += x > cut[i];
+	    }
+	    return b;
+	}
+
+	Discretizer() : _method(DISCRETIZE_MDL), _nBin(10), _nCandidate(256) {}
+};
+
+#endif
@@ -0,0 +1,236 @@
+/**
+ * \file fcbf.cpp
+ * \author Kefei Lu
+ * \brief Implementation of FcbfSelector.
+ * \sa fcbf.h
+ */
+
+#include "fcbf.h"
+#include "parallel.h"
+using namespace std;
+
+/** An attribute over the rows: the code of each value, and the number
+ * of codes. */
+struct CodedColumn {
+    vector<uint32_t>	code;
+    size_t		nCode;
+};
+
+/** Everything the coding threads share. */
+struct CodeJobs {
+    const Dataset*		ds;
+    const Discretizer*		disc;
+    const vector<size_t>*	rows;
+    /** The attributes, one per job. */
+    vector<size_t>		att;
+    /** Element [a]: where attribute a is coded. */
+    vector<CodedColumn>*	col;
+};
+
+static void
+code_job(const size_t i, void* arg)
+{
+    const CodeJobs* jobs = (const CodeJobs*)arg;
+    const size_t a = jobs->att[i];
+    const Column& col = jobs->ds->column(a);
+    const vector<size_t>& rows = *jobs->rows;
+    const bool binned = jobs->disc->binned(a);
+    CodedColumn& coded = (*jobs->col)[a];
+    // The values, then unknown.
+    const size_t nValue = binned ? jobs->disc->num_of_bin(a) :
+	jobs->ds->get_att_desc(a).possible_value_vector().size();
+    coded.nCode = nValue + 1;
+    coded.code.resize(rows.size());
+    for (size_t j=0;j<rows.size();j++) {
+	const Attribute v = col[rows[j]];
+	if (v.unknown) {
+	    coded.code[j] = nValue;
+	} else if (binned) {
+	    coded.code[j] = jobs->disc->bin(a, v.value.num);
+	} else {
+	    coded.code[j] = v.value.nom;
+	}
+    }
+}
+
+/** Entropy of the counts of n values. */
+static double
+entropy(const size_t* count, const size_t nCount, const size_t n)
+{
+    double e = 0;
+    for (size_t i=0;i<nCount;i++) {
+	if (!count[i]) continue;
+	const double p = (double)count[i] / n;
+	e -= p * log(p);
+    }
+    return e;
+}
+
+/** The symmetrical uncertainty of two coded columns, 0 if both are
+ * constant.
+ *
+ * The joint codes are counted in a table if it is no larger than twice
+ * the rows; else, as for two attributes of many values (ports,
+ * addresses), by sorting the pairs of codes, so the memory is bounded
+ * by the rows. Both sum the entropy in the same order. */
+static double
+symmetrical_uncertainty(const CodedColumn& x, const CodedColumn& y)
+{
+    const size_t n = x.code.size();
+    if (n == 0) return 0;
+    vector<size_t> cx(x.nCode, 0), cy(y.nCode, 0);
+    const uint32_t* px = &x.code[0];
+    const uint32_t* py = &y.code[0];
+    for (size_t i=0;i<n;i++) {
+	cx[px[i]] ++;
+	cy[py[i]] ++;
+    }
+    const double hx = entropy(&cx[0], cx.size(), n);
+    const double hy = entropy(&cy[0], cy.size(), n);
+    if (hx + hy <= 0) return 0;
+    double hxy = 0;
+    if (y.nCode <= 2*n / x.nCode) {
+	vector<size_t> joint(x.nCode*y.nCode, 0);
+	for (size_t i=0;i<n;i++) {
+	    joint[px[i]*y.nCode + py[i]] ++;
+	}
+	hxy = entropy(&joint[0], joint.size(), n);
+    } else {
+	vector<uint64_t> pair(n);
+	for (size_t i=0;i<n;i++) {
+	    pair[i] = (uint64_t)px[i] << 32 | py[i];
+	}
+	sort(pair.begin(), pair.end());
+	for (size_t i=0;i<n;) {
+	    size_t j = i+1;
+	    while (j < n && pair[j] == pair[i]) j++;
+	    const double p = (double)(j-i) / n;
+	    hxy -= p * log(p);
+	    i = j;
+	}
+    }
+    return 2 * (hx + hy - hxy) / (hx + hy);
+}
+
+/** Everything the SU threads share. */
+struct SuJobs {
+    /** Job i computes the SU of columns x[i] and y[i]. */
+    vector<const CodedColumn*>	x;
+    vector<const CodedColumn*>	y;
+    vector<double>		su;
+};
+
+static void
+su_job(const size_t i, void* arg)
+{
+    SuJobs* jobs = (SuJobs*)arg;
+    jobs->su[i] = symmetrical_uncertainty(*jobs->x[i], *jobs->y[i]);
+}
+
+/** Order the attributes by decreasing SU with the class, then index. */
+struct BySu {
+    const vector<double>* su;
+    bool operator()(const size_t a, const size_t b) const
+    {
+	if ((*su)[a] != (*su)[b]) return (*su)[a] > (*su)[b];
+	return a < b;
+    }
+};
+
+vector<size_t>
+FcbfSelector::
+select(const Dataset& ds, const size_t classIndex)
+{
+    vector<size_t> rows(ds.num_of_inst());
+    for (size_t i=0;i<rows.size();i++) {
+	rows[i] = i;
+    }
+    return select(ds, classIndex, rows);
+}
+
+vector<size_t>
+FcbfSelector::
+select(const Dataset& ds, const size_t classIndex,
+	const vector<size_t>& allRows)
+{
+    fprintf(stdout, "(I) FCBF: Selecting attributes...\n");
+    const size_t nAtt = ds.num_of_att();
+    vector<size_t> rows;
+    const Column& klass = ds.column(classIndex);
+    for (size_t j=0;j<allRows.size();j++) {
+	if (!klass[allRows[j]].unknown) rows.push_back(allRows[j]);
+    }
+
+    // Discretize the numeric attributes, and code all of them.
+    vector<size_t> att;
+    for (size_t a=0;a<nAtt;a++) {
+	if (a == classIndex) continue;
+	const AttType type = ds.get_att_desc(a).get_type();
+	if (type != ATT_TYPE_NUMERIC && type != ATT_TYPE_NOMINAL) continue;
+	att.push_back(a);
+    }
+    _discretizer.fit(ds, rows, classIndex, att, n_thread());
+    vector<CodedColumn> col(nAtt);
+    CodeJobs code;
+    code.ds = &ds;
+    code.disc = &_discretizer;
+    code.rows = &rows;
+    code.att = att;
+    code.att.push_back(classIndex);
+    code.col = &col;
+    run_parallel(code_job, &code, code.att.size(), n_thread());
+
+    // Relevance: the SU with the class.
+    _su.assign(nAtt, 0);
+    SuJobs jobs;
+    for (size_t i=0;i<att.size();i++) {
+	jobs.x.push_back(&col[att[i]]);
+	jobs.y.push_back(&col[classIndex]);
+    }
+    jobs.su.resize(att.size());
+    run_parallel(su_job, &jobs, att.size(), n_thread());
+    vector<size_t> left;
+    for (size_t i=0;i<att.size();i++) {
+	_su[att[i]] = jobs.su[i];
+	if (jobs.su[i] > threshold()) {
+	    left.push_back(att[i]);
+	} else {
+	    vector<uint32_t>().swap(col[att[i]].code);
+	}
+    }
+    BySu bySu;
+    bySu.su = &_su;
+    sort(left.begin(), left.end(), bySu);
+    fprintf(stdout, "(I) FCBF: %d of %d attributes are relevant.\n",
+	    (int)left.size(), (int)att.size());
+
+    // Redundancy: each attribute left removes the following ones which
+    // are more correlated with it than with the class.
+    for (size_t p=0;p<left.size();p++) {
+	const size_t nq = left.size() - p - 1;
+	jobs.x.assign(nq, &col[left[p]]);
+	jobs.y.resize(nq);
+	for (size_t q=0;q<nq;q++) {
+	    jobs.y[q] = &col[left[p+1+q]];
+	}
+	jobs.su.resize(nq);
+	run_parallel(su_job, &jobs, nq, n_thread());
+	size_t n = p+1;
+	for (size_t q=0;q<nq;q++) {
+	    const size_t a = left[p+1+q];
+	    if (jobs.su[q] >= _su[a]) {
+		vector<uint32_t>().swap(col[a].code);
+		continue;
+	    }
+	    left[n++] = a;
+	}
+	left.resize(n);
+    }
+
+    fprintf(stdout, "(I) FCBF: Selected %d attributes:\n", (int)left.size());
+    for (size_t i=0;i<left.size();i++) {
+	fprintf(stdout, "(I) ... %d %s (SU %.6f)\n", (int)left[i],
+		ds.get_att_desc(left[i]).get_name(), _su[left[i]]);
+    }
+    return left;
+}
@@ -0,0 +1,77 @@
+/**
+ * \file fcbf.h
+ * \author Kefei Lu
+ * \brief Fast Correlation-Based Filter feature selection.
+ * \sa fcbf.cpp
+ */
+
+#ifndef __FCBF_H__
+#define __FCBF_H__
+
+#include "common.h"
+#include "dataset.h"
+#include "discretizer.h"
+
+/**
+ * \brief Selects the attributes of a dataset by FCBF (Yu and Liu, 2003).
+ *
+ * The correlation of two attributes is their symmetrical uncertainty:
+ *
+ * \verbatim
+     SU(X,Y) = 2 * (H(X) + H(Y) - H(X,Y)) / (H(X) + H(Y))
+   \endverbatim
+ *
+ * computed on the nominal values, and on the bins of the numeric
+ *   attributes (see discretizer()). An unknown value counts as a value
+ *   of its own.
+ *
+ * The attributes whose SU with the class is above threshold() are
+ *   relevant. Taken by decreasing SU with the class, each one left
+ *   removes the following ones it is more correlated with than they are
+ *   with the class (redundant). The ones left are selected.
+ *
+ * The SU's are computed in parallel: with the class one job per
+ *   attribute, and then one job per pair of the attribute taken and a
+ *   following one.
+ *
+ * \sa Classifier::only_these_att()
+ */
+class FcbfSelector {
+    private:
+	double		_threshold;
+	size_t		_nThread;
+	Discretizer	_discretizer;
+	/** Element [a]: the SU of attribute a with the class. */
+	vector<double>	_su;
+    public:
+	/** The least SU with the class of a relevant attribute, 0 by
+	 * default: all but the ones independent of the class. */
+	double& threshold(void) {return _threshold;}
+	const double& threshold(void) const {return _threshold;}
+	/** The number of threads, 0 (one per processor) by default. */
+	size_t& n_thread(void) {return _nThread;}
+	const size_t& n_thread(void) const {return _nThread;}
+	/** How the numeric attributes are discretized, MDL by default. */
+	Discretizer& discretizer(void) {return _discretizer;}
+	const Discretizer& discretizer(void) const {return _discretizer;}
+	/** Element [a]: the SU of attribute a with the class, as found by
+	 * the last select(). 0 for the class. */
+	const vector<double>& su(void) const {return _su;}
+
+	/**
+	 * \brief Select attributes on some rows of a dataset.
+	 *
+	 * The rows of unknown class are left out.
+	 *
+	 * \return The attributes selected, by decreasing SU with the
+	 *   class, for Classifier::only_these_att().
+	 */
+	vector<size_t> select(const Dataset& ds, const size_t classIndex,
+		const vector<size_t>& rows);
+	/** Select attributes on all the rows of a dataset. */
+	vector<size_t> select(const Dataset& ds, const size_t classIndex);
+
+	FcbfSelector() : _threshold(0), _nThread(0) {}
+};
+
+#endif
@@ -0,0 +1,485 @@
+/**
+ * \file flow.cpp
+ * \author Kefei Lu
+ * \brief Implementation of the flows, FlowTable and FlowExtractor.
+ * \sa flow.h
+ */
+
+#include "flow.h"
+#include "pcap.h"
+using namespace std;
+
+const size_t FlowDirection::N_FEATURE;
+const size_t Flow::N_FEATURE;
+
+FlowKey
+FlowKey::
+of(const TshPacket& p, bool& fromA)
+{
+    FlowKey k;
+    fromA = p.src < p.dst || (p.src == p.dst && p.sport <= p.dport);
+    if (fromA) {
+	k.a = p.src; k.portA = p.sport;
+	k.b = p.dst; k.portB = p.dport;
+    } else {
+	k.a = p.dst; k.portA = p.dport;
+	k.b = p.src; k.portB = p.sport;
+    }
+    k.protocol = p.protocol;
+    return k;
+}
+
+void
+InterArrival::
+add(const uint64_t time)
+{
+    if (seen) {
+	const double t = time > last ? (time - last) * 1e-6 : 0;
+	if (moments.n() == 0) {
+	    min = max = t;
+	} else {
+	    if (t < min) min = t;
+	    if (t > max) max = t;
+	}
+	moments.add(t);
+    }
+    last = time;
+    seen = 1;
+}
+
+FlowDirection::
+FlowDirection() :
+    packets(0), sizeMin(0), sizeMax(0), bytes(0), payload(0),
+    pureAck(0), push(0), urg(0), syn(0), fin(0), rst(0)
+{
+}
+
+const char*
+FlowDirection::
+name(const size_t i)
+{
+    static const char* names[N_FEATURE] = {
+	"packets", "bytes", "payload_bytes",
+	"size_min", "size_mean", "size_max", "size_var",
+	"iat_min", "iat_mean", "iat_max", "iat_var",
+	"pure_ack", "push", "urg", "syn", "fin", "rst"
+    };
+    assert(i < N_FEATURE);
+    return names[i];
+}
+
+void
+FlowDirection::
+add(const TshPacket& p)
+{
+    if (packets == 0) {
+	sizeMin = sizeMax = p.length;
+    } else {
+	sizeMin = min(sizeMin, p.length);
+	sizeMax = max(sizeMax, p.length);
+    }
+    packets ++;
+    bytes += p.length;
+    const size_t load = p.payload();
+    payload += load;
+    size.add(p.length);
+
+    if (p.flags & TCP_PSH) push ++;
+    if (p.flags & TCP_URG) urg ++;
+    if (p.flags & TCP_SYN) syn ++;
+    if (p.flags & TCP_FIN) fin ++;
+    if (p.flags & TCP_RST) rst ++;
+    if ((p.flags & (TCP_ACK|TCP_SYN|TCP_FIN|TCP_RST)) == TCP_ACK && load == 0) {
+	pureAck ++;
+    }
+}
+
+FlowDirection&
+FlowDirection::
+operator+=(const FlowDirection& o)
+{
+    if (o.packets == 0) return *this;
+    if (packets == 0) {
+	sizeMin = o.sizeMin;
+	sizeMax = o.sizeMax;
+    } else {
+	sizeMin = min(sizeMin, o.sizeMin);
+	sizeMax = max(sizeMax, o.sizeMax);
+    }
+    packets += o.packets;
+    bytes += o.bytes;
+    payload += o.payload;
+    size += o.size;
+    pureAck += o.pureAck;
+    push += o.push;
+    urg += o.urg;
+    syn += o.syn;
+    fin += o.fin;
+    rst += o.rst;
+    return *this;
+}
+
+/** The unbiased variance, 0 for less than 2 values. */
+static inline double
+variance(const RunningMoments& m)
+{
+    return m.n() > 1 ? m.m2() / (m.n() - 1) : 0;
+}
+
+void
+FlowDirection::
+features(const InterArrival& iat, double* f) const
+{
+    f[0] = packets;
+    f[1] = bytes;
+    f[2] = payload;
+    f[3] = sizeMin;
+    f[4] = size.mean();
+    f[5] = sizeMax;
+    f[6] = variance(size);
+    f[7] = iat.min;
+    f[8] = iat.moments.mean();
+    f[9] = iat.max;
+    f[10] = variance(iat.moments);
+    f[11] = pureAck;
+    f[12] = push;
+    f[13] = urg;
+    f[14] = syn;
+    f[15] = fin;
+    f[16] = rst;
+}
+
+string
+Flow::
+name(const size_t i)
+{
+    static const char* prefix[3] = {"", "c2s_", "s2c_"};
+    static const char* names[N_FEATURE - 3*FlowDirection::N_FEATURE] = {
+	"duration", "server_port", "client_port",
+	"c2s_init_window", "s2c_init_window"
+    };
+    assert(i < N_FEATURE);
+    const size_t n = FlowDirection::N_FEATURE;
+    if (i < 3*n) return string(prefix[i/n]) + FlowDirection::name(i%n);
+    return names[i - 3*n];
+}
+
+void
+Flow::
+start(const TshPacket& p, const FlowKey& k, const bool fromA)
+{
+    key = k;
+    clientIsA = fromA;
+    finSeen[0] = finSeen[1] = 0;
+    rstSeen = 0;
+    decided = 0;
+    windowSeen[0] = windowSeen[1] = 0;
+    initWindow[0] = initWindow[1] = 0;
+    clientPort = p.sport;
+    serverPort = p.dport;
+    first = p.time;
+    for (size_t d=0;d<2;d++) dir[d] = FlowDirection();
+    for (size_t d=0;d<3;d++) iat[d] = InterArrival();
+    add(p, fromA);
+}
+
+void
+Flow::
+add(const TshPacket& p, const bool fromA)
+{
+    // 0 from the client, 1 from the server.
+    const size_t side = fromA == clientIsA ? 0 : 1;
+    dir[side].add(p);
+    iat[0].add(p.time);
+    iat[1+side].add(p.time);
+    if (!windowSeen[side]) {
+	initWindow[side] = p.window;
+	windowSeen[side] = 1;
+    }
+    if (p.flags & TCP_FIN) finSeen[side] = 1;
+    if (p.flags & TCP_RST) rstSeen = 1;
+}
+
+void
+Flow::
+features(double* f) const
+{
+    const size_t n = FlowDirection::N_FEATURE;
+    FlowDirection both = dir[0];
+    both += dir[1];
+    both.features(iat[0], f);
+    dir[0].features(iat[1], f + n);
+    dir[1].features(iat[2], f + 2*n);
+    f += 3*n;
+    f[0] = (last() - first) * 1e-6;
+    f[1] = serverPort;
+    f[2] = clientPort;
+    f[3] = initWindow[0];
+    f[4] = initWindow[1];
+}
+
+void
+Flow::
+to_instance(Instance& inst) const
+{
+    assert(inst.size() >= N_FEATURE);
+    double f[N_FEATURE];
+    features(f);
+    for (size_t j=0;j<N_FEATURE;j++) {
+	inst[j].unknown = 0;
+	inst[j].value.num = f[j];
+    }
+    for (size_t j=N_FEATURE;j<inst.size();j++) {
+	inst[j].unknown = 1;
+	inst[j].value.nom = 0;
+    }
+}
+
+/** Order flows by the time they started, then key. */
+static bool
+by_start(const Flow& x, const Flow& y)
+{
+    if (x.first != y.first) return x.first < y.first;
+    return x.key < y.key;
+}
+
+FlowTable::
+FlowTable(const size_t capacity) :
+    _size(0), _idleTimeout(64000000), _closedTimeout(1000000), _nextSweep(0),
+    _nStarted(0), _nSkipped(0)
+{
+    size_t n = 16;
+    while (n < capacity) n *= 2;
+    Slot empty;
+    memset(&empty, 0, sizeof(empty));
+    _slot.assign(n, empty);
+    _flow.resize(n);
+    _mask = n - 1;
+}
+
+void
+FlowTable::
+remove(size_t i)
+{
+    // Move back each following key which can not be reached from its
+    // home slot any more, until an empty slot.
+    for (size_t j=(i+1)&_mask; _slot[j].used; j=(j+1)&_mask) {
+	const size_t h = _slot[j].key.hash() & _mask;
+	const bool reachable = i <= j ? (i < h && h <= j) : (i < h || h <= j);
+	if (reachable) continue;
+	_slot[i] = _slot[j];
+	_flow[i] = _flow[j];
+	i = j;
+    }
+    _slot[i].used = 0;
+    _size --;
+}
+
+void
+FlowTable::
+grow()
+{
+    vector<Slot> slot(_slot.size() * 2);
+    vector<Flow> flow(slot.size());
+    for (size_t i=0;i<slot.size();i++) slot[i].used = 0;
+    _slot.swap(slot);
+    _flow.swap(flow);
+    _mask = _slot.size() - 1;
+    for (size_t i=0;i<slot.size();i++) {
+	if (!slot[i].used) continue;
+	const size_t j = find(slot[i].key);
+	_slot[j] = slot[i];
+	_flow[j] = flow[i];
+    }
+}
+
+void
+FlowTable::
+sweep(const uint64_t now)
+{
+    vector<Flow> idle;
+    for (size_t i=0;i<_slot.size();) {
+	if (_slot[i].used && timed_out(_flow[i], now)) {
+	    idle.push_back(_flow[i]);
+	    // A following flow may be moved into slot i.
+	    remove(i);
+	} else {
+	    i ++;
+	}
+    }
+    sort(idle.begin(), idle.end(), by_start);
+    _done.insert(_done.end(), idle.begin(), idle.end());
+}
+
+Flow*
+FlowTable::
+update(const TshPacket& p)
+{
+    if (p.protocol != IP_PROTO_TCP || p.fragOffset || (p.ipFlags & 0x1)) {
+	_nSkipped ++;
+	return NULL;
+    }
+    if ((_idleTimeout || _closedTimeout) && p.time >= _nextSweep) {
+	sweep(p.time);
+	uint64_t every = max(_idleTimeout, _closedTimeout);
+	if (_idleTimeout) every = min(every, _idleTimeout);
+	if (_closedTimeout) every = min(every, _closedTimeout);
+	_nextSweep = p.time + max(every / 4, (uint64_t)1);
+    }
+    bool fromA;
+    const FlowKey k = FlowKey::of(p, fromA);
+    size_t i = find(k);
+    if (_slot[i].used) {
+	Flow& f = _flow[i];
+	const bool syn = (p.flags & (TCP_SYN|TCP_ACK)) == TCP_SYN;
+	if (!(syn && f.closed()) && !timed_out(f, p.time)) {
+	    f.add(p, fromA);
+	    return &f;
+	}
+	// The flow is over, and the packet starts a new one.
+	_done.push_back(f);
+	f.start(p, k, fromA);
+	_nStarted ++;
+	return &f;
+    }
+    if ((_size+1)*2 > _slot.size()) {
+	grow();
+	i = find(k);
+    }
+    _slot[i].key = k;
+    _slot[i].used = 1;
+    _size ++;
+    _flow[i].start(p, k, fromA);
+    _nStarted ++;
+    return &_flow[i];
+}
+
+void
+FlowTable::
+flush()
+{
+    vector<Flow> all;
+    all.reserve(_size);
+    for (size_t i=0;i<_slot.size();i++) {
+	if (!_slot[i].used) continue;
+	all.push_back(_flow[i]);
+	_slot[i].used = 0;
+    }
+    _size = 0;
+    sort(all.begin(), all.end(), by_start);
+    _done.insert(_done.end(), all.begin(), all.end());
+}
+
+bool
+FlowTable::
+pop(Flow& flow)
+{
+    if (_done.empty()) return 0;
+    flow = _done.front();
+    _done.pop_front();
+    return 1;
+}
+
+bool
+FlowTable::
+pop(Instance& inst)
+{
+    if (_done.empty()) return 0;
+    _done.front().to_instance(inst);
+    _done.pop_front();
+    return 1;
+}
+
+void
+FlowExtractor::
+make_schema(Dataset& ds, const vector<string>& classes)
+{
+    for (size_t i=0;i<Flow::N_FEATURE;i++) {
+	ds.add_att(AttDesc(Flow::name(i).c_str(), ATT_TYPE_NUMERIC));
+    }
+    if (classes.empty()) return;
+    AttDesc klass("class", ATT_TYPE_NOMINAL);
+    klass.possible_value_vector() = classes;
+    ds.add_att(klass);
+}
+
+void
+FlowExtractor::
+add(const TshPacket& p)
+{
+    Flow* f = _table.update(p);
+    if (f && _firstN && !f->decided && f->packets() == _firstN) {
+	_early.push_back(*f);
+	f->decided = 1;
+    }
+}
+
+void
+FlowExtractor::
+pop(Dataset& ds)
+{
+    assert(ds.num_of_att() >= Flow::N_FEATURE);
+    Instance inst(ds.num_of_att());
+    for (; !_early.empty(); _early.pop_front()) {
+	_early.front().to_instance(inst);
+	ds.push_back(inst);
+    }
+    Flow f;
+    while (_table.pop(f)) {
+	// Those cut early are already in.
+	if (f.decided) continue;
+	f.to_instance(inst);
+	ds.push_back(inst);
+    }
+}
+
+void
+FlowExtractor::
+flush(Dataset& ds)
+{
+    _table.flush();
+    pop(ds);
+}
+
+/** Add n packets to the flows, and append those completed to ds. */
+static void
+add_block(FlowExtractor& ext, const TshPacket* block, const size_t n,
+	Dataset& ds)
+{
+    for (size_t i=0;i<n;i++) ext.add(block[i]);
+    ext.pop(ds);
+}
+
+size_t
+extract_flows(const char* trace_file, Dataset& ds, const size_t firstN)
+{
+    if (ds.num_of_att() == 0) {
+	FlowExtractor::make_schema(ds, vector<string>());
+    }
+    FlowExtractor ext;
+    ext.first_n() = firstN;
+    // Decode a block at a time, small enough to stay in cache.
+    const size_t BLOCK = 4096;
+    vector<TshPacket> block(BLOCK);
+    size_t n;
+    if (PcapReader::is_pcap(trace_file)) {
+	PcapReader capture(trace_file);
+	while ((n = capture.next(&block[0], BLOCK)) > 0) {
+	    add_block(ext, &block[0], n, ds);
+	}
+	fprintf(stdout, "(I) Read %d frames: %d not IPv4, %d truncated.\n",
+		(int)capture.num_of_frame(), (int)capture.num_of_skipped(),
+		(int)capture.num_of_truncated());
+    } else {
+	const TshReader trace(trace_file);
+	for (size_t first=0;
+		(n = trace.decode(first, BLOCK, &block[0])) > 0; first+=n) {
+	    add_block(ext, &block[0], n, ds);
+	}
+    }
+    ext.flush(ds);
+    const FlowTable& table = ext.table();
+    fprintf(stdout, "(I) %d flows, %d packets skipped.\n",
+	    (int)table.num_of_started(), (int)table.num_of_skipped());
+    return table.num_of_started();
+}
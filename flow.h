@@ -0,0 +1,310 @@
+/**
+ * \file flow.h
+ * \author Kefei Lu
+ * \brief TCP flows of a packet trace, and their features.
+ * \sa flow.cpp, tsh.h
+ */
+
+#ifndef __FLOW_H__
+#define __FLOW_H__
+
+#include "common.h"
+#include "dataset.h"
+#include "classifier.h"
+#include "tsh.h"
+#include <deque>
+
+/**
+ * \brief The 5-tuple of a flow, the same for both directions.
+ *
+ * The (address, port) endpoints are ordered so that a is the lesser one.
+ */
+struct FlowKey {
+    uint32_t	a;
+    uint32_t	b;
+    uint16_t	portA;
+    uint16_t	portB;
+    uint8_t	protocol;
+
+    /**
+     * \brief The key of the flow of a packet.
+     *
+     * \param fromA Set to whether the packet is sent by endpoint a.
+     */
+    static FlowKey of(const TshPacket& p, bool& fromA);
+
+    /** A hash of all the fields. */
+    uint64_t hash() const
+    {
+	uint64_t h = ((uint64_t)a << 32 | b) * 0x9E3779B97F4A7C15ULL;
+	h ^= ((uint64_t)portA << 24 | (uint64_t)portB << 8 | protocol)
+	    * 0xC2B2AE3D27D4EB4FULL;
+	return h ^ (h >> 29);
+    }
+    bool operator==(const FlowKey& o) const
+    {
+	return a == o.a && b == o.b && portA == o.portA && portB == o.portB
+	    && protocol == o.protocol;
+    }
+    bool operator<(const FlowKey& o) const
+    {
+	if (a != o.a) return a < o.a;
+	if (b != o.b) return b < o.b;
+	if (portA != o.portA) return portA < o.portA;
+	if (portB != o.portB) return portB < o.portB;
+	return protocol < o.protocol;
+    }
+};
+
+/**
+ * \brief The statistics of the inter-arrival times of packets.
+ *
+ * In seconds. Updated in constant time and space.
+ */
+struct InterArrival {
+    uint64_t	last;		///< Time of the last packet.
+    bool	seen;		///< Whether there has been a packet.
+    double	min;
+    double	max;
+    RunningMoments moments;
+
+    void add(const uint64_t time);
+    InterArrival() : last(0), seen(0), min(0), max(0) {}
+};
+
+/**
+ * \brief The statistics of the sizes and flags of the packets of a
+ *   flow in one direction.
+ *
+ * Updated in constant time and space. Those of both directions are the
+ *   sum (+=) of the two.
+ */
+struct FlowDirection {
+    uint32_t	packets;
+    uint16_t	sizeMin;
+    uint16_t	sizeMax;
+    uint64_t	bytes;		///< IP total lengths.
+    uint64_t	payload;	///< TCP payload bytes.
+    RunningMoments size;	///< Of the IP total lengths.
+    uint32_t	pureAck;	///< ACK, no payload nor SYN/FIN/RST.
+    uint32_t	push;
+    uint32_t	urg;
+    uint32_t	syn;
+    uint32_t	fin;
+    uint32_t	rst;
+
+    /** The number of features(). */
+    static const size_t N_FEATURE = 17;
+    /** The name of feature i, e.g. "size_mean". */
+    static const char* name(const size_t i);
+
+    void add(const TshPacket& p);
+    FlowDirection& operator+=(const FlowDirection& o);
+    /** Write the N_FEATURE features, with the inter-arrival times. */
+    void features(const InterArrival& iat, double* out) const;
+
+    FlowDirection();
+};
+
+/**
+ * \brief A bidirectional TCP flow and its discriminators.
+ *
+ * The client is the sender of the first packet seen, the server the
+ *   receiver. The features, after A. Moore's discriminators, are the
+ *   FlowDirection ones of all the packets, the client to server ones and
+ *   the server to client ones, then the duration, the ports and the
+ *   initial windows.
+ */
+struct Flow {
+    FlowKey	key;
+    /** Whether the client is endpoint a of the key. */
+    bool	clientIsA;
+    bool	finSeen[2];	///< Client, server.
+    bool	rstSeen;
+    /** Whether the flow has been classified, or its first packets
+     * taken as a row (FlowExtractor::first_n()). */
+    bool	decided;
+    bool	windowSeen[2];
+    uint16_t	initWindow[2];
+    uint16_t	clientPort;
+    uint16_t	serverPort;
+    uint64_t	first;		///< Time of the first packet.
+    /** Client to server, server to client. */
+    FlowDirection dir[2];
+    /** All packets, client to server, server to client. */
+    InterArrival iat[3];
+
+    /** The number of features(). */
+    static const size_t N_FEATURE = 3 * FlowDirection::N_FEATURE + 5;
+    /** The name of feature i, e.g. "c2s_size_mean". */
+    static string name(const size_t i);
+
+    /** Start a flow with its first packet. */
+    void start(const TshPacket& p, const FlowKey& k, const bool fromA);
+    /** Add a packet of the flow. */
+    void add(const TshPacket& p, const bool fromA);
+    /** The number of packets. */
+    size_t packets() const {return dir[0].packets + dir[1].packets;}
+    /** Time of the last packet. */
+    uint64_t last() const {return iat[0].last;}
+    /** Whether a RST, or a FIN both ways, has been seen. */
+    bool closed() const {return rstSeen || (finSeen[0] && finSeen[1]);}
+    /** Write the N_FEATURE features. */
+    void features(double* out) const;
+    /**
+     * \brief Make the flow a row of the make_schema() schema.
+     *
+     * inst has one attribute per AttDesc. Those after the features, e.g.
+     *   the class, are unknown.
+     */
+    void to_instance(Instance& inst) const;
+};
+
+/**
+ * \brief The flows being tracked, looked up by 5-tuple.
+ *
+ * An open addressing hash table with linear probing, of the keys and,
+ *   aside, the flows. A packet is looked up and added to its flow in
+ *   constant (amortized) time; the table doubles when half full.
+ *
+ * A flow is completed when a SYN starts a new flow of its key after it
+ *   is closed(), when it has been idle for idle_timeout(), or
+ *   closed_timeout() once closed(), or by flush(). The completed flows
+ *   are queued, in this order, until pop()'ed.
+ */
+class FlowTable {
+    private:
+	struct Slot {
+	    FlowKey	key;
+	    bool	used;
+	};
+	vector<Slot>	_slot;
+	/** The flow of each used slot. */
+	vector<Flow>	_flow;
+	size_t		_size;
+	size_t		_mask;
+	deque<Flow>	_done;
+	uint64_t	_idleTimeout;
+	uint64_t	_closedTimeout;
+	/** Time of the next sweep for idle flows. */
+	uint64_t	_nextSweep;
+	size_t		_nStarted;
+	size_t		_nSkipped;
+
+	/** The slot of k, or the free one where it would go. */
+	size_t find(const FlowKey& k) const
+	{
+	    size_t i = k.hash() & _mask;
+	    while (_slot[i].used && !(_slot[i].key == k)) i = (i+1) & _mask;
+	    return i;
+	}
+	/** Empty slot i, shifting back the keys probed past it. */
+	void remove(size_t i);
+	void grow();
+	/** Whether flow f is over at time now. */
+	bool timed_out(const Flow& f, const uint64_t now) const
+	{
+	    const uint64_t timeout = f.closed() ? _closedTimeout : _idleTimeout;
+	    return timeout && f.last() + timeout <= now;
+	}
+	/** Complete the flows timed out at time now. */
+	void sweep(const uint64_t now);
+    public:
+	/** Idle time after which a flow is completed, in microseconds. */
+	uint64_t& idle_timeout() {return _idleTimeout;}
+	const uint64_t& idle_timeout() const {return _idleTimeout;}
+	/** Idle time after which a closed() flow is completed, in
+	 * microseconds. Its last packets, e.g. the ACK of the last FIN, are
+	 * counted until then. */
+	uint64_t& closed_timeout() {return _closedTimeout;}
+	const uint64_t& closed_timeout() const {return _closedTimeout;}
+
+	/**
+	 * \brief Add a packet to its flow, starting one if needed.
+	 *
+	 * Packets are added in time order.
+	 *
+	 * \return The flow, valid until the next update(), or NULL if the
+	 *   packet is skipped: it is not TCP or is a fragment.
+	 */
+	Flow* update(const TshPacket& p);
+	/** Complete all the flows, in the order they started. */
+	void flush();
+
+	/** The number of flows being tracked. */
+	size_t size() const {return _size;}
+	/** The number of flows started. */
+	size_t num_of_started() const {return _nStarted;}
+	/** The number of packets skipped. */
+	size_t num_of_skipped() const {return _nSkipped;}
+	/** The number of completed flows not yet pop()'ed. */
+	size_t num_of_done() const {return _done.size();}
+	/** Take the oldest completed flow. \return 0 if there is none. */
+	bool pop(Flow& flow);
+	/** pop() a flow as a row, see Flow::to_instance(). */
+	bool pop(Instance& inst);
+
+	/** \param capacity Rounded up to a power of 2. */
+	FlowTable(const size_t capacity = 1024);
+};
+
+/**
+ * \brief Group the packets of a trace into TCP flows, and make each
+ *   flow a row of a Dataset.
+ *
+ * Packets are add()'ed in time order, to a FlowTable. The rows are in
+ *   the order the flows are completed.
+ *
+ * With first_n(), a flow is made a row as soon as it has first_n()
+ *   packets, from these packets only: the features an online classifier
+ *   sees when it decides early (OnlineClassifier), to train it on.
+ *
+ * \sa extract_flows()
+ */
+class FlowExtractor {
+    private:
+	FlowTable	_table;
+	size_t		_firstN;
+	/** The flows cut at first_n() packets, not yet pop()'ed. */
+	deque<Flow>	_early;
+    public:
+	/**
+	 * \brief Make the schema of the flows in an empty dataset.
+	 *
+	 * The Flow::N_FEATURE numeric attributes, then if there are
+	 *   classes a nominal "class" attribute of these values.
+	 */
+	static void make_schema(Dataset& ds, const vector<string>& classes);
+
+	FlowTable& table() {return _table;}
+	const FlowTable& table() const {return _table;}
+	/** The number of packets a row is made of, 0 for whole flows. */
+	size_t& first_n() {return _firstN;}
+	const size_t& first_n() const {return _firstN;}
+
+	void add(const TshPacket& p);
+	/** Append a row per completed flow to ds. */
+	void pop(Dataset& ds);
+	/**
+	 * \brief Append a row per flow to ds, then forget them.
+	 *
+	 * ds is of the schema of make_schema().
+	 */
+	void flush(Dataset& ds);
+
+	FlowExtractor() : _firstN(0) {}
+};
+
+/**
+ * \brief Read a TSH trace, or a pcap or pcap-ng capture (PcapReader),
+ *   and append its flows to ds.
+ *
+ * make_schema() is called if ds has no attribute.
+ *
+ * \param firstN See FlowExtractor::first_n().
+ * \return The number of flows.
+ */
+size_t extract_flows(const char* trace_file, Dataset& ds,
+	const size_t firstN = 0);
+
+#endif
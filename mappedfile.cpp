@@ -0,0 +1,79 @@
+/**
+ * \file mappedfile.cpp
+ * \author Kefei Lu
+ * \brief Implementation of MappedFile.
+ * \sa mappedfile.h
+ */
+
+#include "mappedfile.h"
+
+#ifdef linux
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+#endif
+
+int
+MappedFile::open(const char* file)
+{
+    close();
+#ifdef linux
+    int fd = ::open(file, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+	::close(fd);
+	return -1;
+    }
+    _size = st.st_size;
+    if (_size == 0) {
+	// mmap() refuses an empty mapping.
+	::close(fd);
+	return 0;
+    }
+    void* p = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping holds its own reference to the file.
+    ::close(fd);
+    if (p == MAP_FAILED) {
+	_size = 0;
+	return -1;
+    }
+    madvise(p, _size, MADV_SEQUENTIAL);
+    _data = (const char*)p;
+#else
+    FILE* fp = fopen(file, "rb");
+    if (!fp) return -1;
+    fseek(fp, 0, SEEK_END);
+    _size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (_size == 0) {
+	fclose(fp);
+	return 0;
+    }
+    char* buf = new char [_size];
+    if (fread(buf, 1, _size, fp) != _size) {
+	delete [] buf;
+	fclose(fp);
+	_size = 0;
+	return -1;
+    }
+    fclose(fp);
+    _data = buf;
+#endif
+    return 0;
+}
+
+void
+MappedFile::close()
+{
+    if (_data) {
+#ifdef linux
+	munmap((void*)_data, _size);
+#else
+	delete [] _data;
+#endif
+    }
+    _data = NULL;
+    _size = 0;
+}
@@ -0,0 +1,52 @@
+/**
+ * \file mappedfile.h
+ * \author Kefei Lu
+ * \brief A read-only file mapped into memory.
+ * \sa mappedfile.cpp
+ */
+
+#ifndef __MAPPEDFILE_H__
+#define __MAPPEDFILE_H__
+
+#include "common.h"
+
+/**
+ * \brief A whole file, read-only, in memory.
+ *
+ * On linux the file is mmap'ed, so that the pages are only read in when 
+ *   they are touched and no copy is made. Elsewhere the file is simply 
+ *   read into a heap buffer.
+ *
+ * The content is NOT null terminated. Use size().
+ */
+class MappedFile {
+    private:
+	const char*	_data;
+	size_t		_size;
+
+	// Not copyable.
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+    public:
+	/**
+	 * \brief Map a file.
+	 *
+	 * A previously mapped file is closed first.
+	 *
+	 * \return 0 on success, -1 if the file can not be opened or mapped.
+	 */
+	int open(const char* file);
+	/** Unmap the file. It is safe to call on a closed one. */
+	void close();
+
+	/** The first byte of the file, NULL if empty or not opened. */
+	const char* data() const {return _data;}
+	/** The size of the file in bytes. */
+	size_t size() const {return _size;}
+
+	MappedFile() : _data(NULL), _size(0) {}
+	~MappedFile() {close();}
+};
+
+#endif
@@ -0,0 +1,305 @@
+/**
+ * \file online.cpp
+ * \author Kefei Lu
+ * \brief Implementation of OnlineClassifier.
+ * \sa online.h
+ */
+
+#include "online.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+using namespace std;
+
+/** Set by SIGINT and SIGTERM to stop serve(). */
+static volatile sig_atomic_t stopServing = 0;
+
+static void
+on_stop(int)
+{
+    stopServing = 1;
+}
+
+/** Monotonic wall time, in seconds. */
+static double
+now()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+OnlineClassifier::
+OnlineClassifier(const CompiledModel& model) :
+    _model(model), _firstN(0), _binary(0), _out(stdout), _reportEvery(0),
+    _nPartial(0), _block(1024), _nPacket(0), _nEarly(0), _nEnd(0),
+    _start(0), _busy(0), _arrival(0), _lastReport(0), _maxLatency(0)
+{
+    const Dataset& schema = model.schema();
+    bool ok = schema.num_of_att() > Flow::N_FEATURE
+	&& model.class_index() >= Flow::N_FEATURE
+	&& schema.get_att_desc(model.class_index()).get_type() == ATT_TYPE_NOMINAL;
+    for (size_t j=0;ok && j<Flow::N_FEATURE;j++) {
+	ok = Flow::name(j) == schema.get_att_desc(j).get_name();
+    }
+    if (!ok) {
+	fprintf(stderr, "(E) The model is not one of flow features.\n");
+	exit(1);
+    }
+    _inst.resize(schema.num_of_att());
+    _logL.resize(model.num_of_class());
+}
+
+void
+OnlineClassifier::
+decide(const Flow& f)
+{
+    f.to_instance(_inst);
+    const InstanceRef inst(_inst);
+    // As CompiledModel::classify(), keeping the log likelihoods.
+    const size_t nClass = _model.num_of_class();
+    size_t label = 0;
+    double best = -HUGE_VAL;
+    for (size_t c=0;c<nClass;c++) {
+	_logL[c] = _model.log_likelihood(c, inst);
+	if (_logL[c] > best) {
+	    best = _logL[c];
+	    label = c;
+	}
+    }
+    double sum = 0;
+    for (size_t c=0;c<nClass;c++) sum += exp(_logL[c] - best);
+    const double posterior = best == -HUGE_VAL ? 1.0 / nClass : 1 / sum;
+
+    const uint32_t client = f.clientIsA ? f.key.a : f.key.b;
+    const uint32_t server = f.clientIsA ? f.key.b : f.key.a;
+    if (_binary) {
+	FlowDecision d;
+	memset(&d, 0, sizeof(d));
+	d.time = f.last();
+	d.client = client;
+	d.server = server;
+	d.clientPort = f.clientPort;
+	d.serverPort = f.serverPort;
+	d.label = label;
+	d.posterior = (float)posterior;
+	d.packets = f.packets();
+	fwrite(&d, sizeof(d), 1, _out);
+    } else {
+	const AttDesc& klass = _model.schema().get_att_desc(_model.class_index());
+	fprintf(_out, "%llu.%06u %u.%u.%u.%u:%u %u.%u.%u.%u:%u %s %.6f %u\n",
+		(unsigned long long)(f.last() / 1000000),
+		(unsigned)(f.last() % 1000000),
+		client >> 24, client >> 16 & 0xff, client >> 8 & 0xff,
+		client & 0xff, f.clientPort,
+		server >> 24, server >> 16 & 0xff, server >> 8 & 0xff,
+		server & 0xff, f.serverPort,
+		klass.possible_value_vector()[label].c_str(), posterior,
+		(unsigned)f.packets());
+    }
+
+    const double latency = (now() - _arrival) * 1e6;
+    _latency.add(latency);
+    _maxLatency = max(_maxLatency, latency);
+    _delay.add((f.last() - f.first) * 1e-6);
+}
+
+void
+OnlineClassifier::
+packet(const TshPacket& p)
+{
+    _nPacket ++;
+    Flow* f = _table.update(p);
+    if (f && _firstN && !f->decided && f->packets() >= _firstN) {
+	decide(*f);
+	f->decided = 1;
+	_nEarly ++;
+    }
+    // The flows completed before deciding.
+    if (!_table.num_of_done()) return;
+    Flow done;
+    while (_table.pop(done)) {
+	if (done.decided) continue;
+	decide(done);
+	_nEnd ++;
+    }
+}
+
+void
+OnlineClassifier::
+feed(const char* data, const size_t n)
+{
+    _arrival = now();
+    if (_start == 0) _start = _arrival;
+    const unsigned char* p = (const unsigned char*)data;
+    const unsigned char* end = p + n;
+    const size_t RECORD = TshReader::RECORD;
+
+    // Complete the record split by the last feed().
+    if (_nPartial) {
+	const size_t m = min(RECORD - _nPartial, n);
+	memcpy(_partial + _nPartial, p, m);
+	_nPartial += m;
+	p += m;
+	if (_nPartial < RECORD) return;
+	TshReader::decode(_partial, _block[0]);
+	packet(_block[0]);
+	_nPartial = 0;
+    }
+    // Decode a block at a time, as TshReader::decode().
+    while ((size_t)(end - p) >= RECORD) {
+	const size_t m = min((size_t)(end - p) / RECORD, _block.size());
+	for (size_t i=0;i<m;i++, p+=RECORD) {
+	    TshReader::decode(p, _block[i]);
+	}
+	for (size_t i=0;i<m;i++) packet(_block[i]);
+    }
+    memcpy(_partial, p, end - p);
+    _nPartial = end - p;
+
+    fflush(_out);
+    _busy += now() - _arrival;
+}
+
+void
+OnlineClassifier::
+end_stream()
+{
+    if (!_nPartial) return;
+    fprintf(stderr, "(W) The stream ends with a truncated record, "
+	    "left out.\n");
+    _nPartial = 0;
+}
+
+void
+OnlineClassifier::
+finish()
+{
+    _arrival = now();
+    end_stream();
+    _table.flush();
+    Flow done;
+    while (_table.pop(done)) {
+	if (done.decided) continue;
+	decide(done);
+	_nEnd ++;
+    }
+    fflush(_out);
+    _busy += now() - _arrival;
+}
+
+void
+OnlineClassifier::
+report(FILE* fp) const
+{
+    const double wall = _start ? now() - _start : 0;
+    fprintf(fp, "(I) Online: %lu packets in %.3f s: %.0f packets/s, "
+	    "%.0f packets/s busy.\n", (unsigned long)_nPacket, wall,
+	    wall > 0 ? _nPacket / wall : 0, _busy > 0 ? _nPacket / _busy : 0);
+    fprintf(fp, "(I) Online: %lu flows decided, %lu at %lu packets, "
+	    "%lu when completed; %lu flows tracked.\n",
+	    (unsigned long)(_nEarly + _nEnd), (unsigned long)_nEarly,
+	    (unsigned long)_firstN, (unsigned long)_nEnd,
+	    (unsigned long)_table.size());
+    fprintf(fp, "(I) Online: decision latency mean %.2f us, max %.2f us; "
+	    "%.3f s after the first packet on average.\n",
+	    _latency.mean(), _maxLatency, _delay.mean());
+}
+
+void
+OnlineClassifier::
+serve_fd(const int fd)
+{
+    vector<char> buf(1 << 16);
+    while (!stopServing) {
+	const ssize_t r = read(fd, &buf[0], buf.size());
+	if (r < 0) {
+	    if (errno == EINTR) continue;
+	    fprintf(stderr, "(W) Reading the stream failed: %s.\n",
+		    strerror(errno));
+	    break;
+	}
+	if (r == 0) break;
+	feed(&buf[0], r);
+	if (_reportEvery > 0 && _arrival - _lastReport >= _reportEvery) {
+	    report(stderr);
+	    _lastReport = _arrival;
+	}
+    }
+    end_stream();
+}
+
+void
+OnlineClassifier::
+serve(const char* input)
+{
+    // No SA_RESTART: a blocked read() or accept() returns on a signal.
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    stopServing = 0;
+    _lastReport = now();
+
+    if (strcmp(input, "-") == 0) {
+	fprintf(stderr, "(I) Reading the stream from stdin...\n");
+	serve_fd(0);
+    } else if (strncmp(input, "unix:", 5) == 0) {
+	const char* path = input + 5;
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+	    fprintf(stderr, "(E) Socket path %s is too long.\n", path);
+	    exit(1);
+	}
+	strcpy(addr.sun_path, path);
+	const int s = socket(AF_UNIX, SOCK_STREAM, 0);
+	unlink(path);
+	if (s < 0 || bind(s, (sockaddr*)&addr, sizeof(addr)) != 0
+		|| listen(s, 1) != 0) {
+	    fprintf(stderr, "(E) Listening on %s failed: %s.\n", path,
+		    strerror(errno));
+	    exit(1);
+	}
+	fprintf(stderr, "(I) Listening on %s...\n", path);
+	while (!stopServing) {
+	    const int fd = accept(s, NULL, NULL);
+	    if (fd < 0) {
+		if (errno == EINTR) continue;
+		fprintf(stderr, "(E) Accepting on %s failed: %s.\n", path,
+			strerror(errno));
+		exit(1);
+	    }
+	    serve_fd(fd);
+	    close(fd);
+	}
+	close(s);
+	unlink(path);
+    } else {
+	struct stat st;
+	const bool fifo = stat(input, &st) == 0 && S_ISFIFO(st.st_mode);
+	fprintf(stderr, "(I) Reading the stream from %s...\n", input);
+	do {
+	    const int fd = open(input, O_RDONLY);
+	    if (fd < 0) {
+		if (errno == EINTR) continue;
+		fprintf(stderr, "(E) Opening file %s failed.\n", input);
+		exit(1);
+	    }
+	    serve_fd(fd);
+	    close(fd);
+	} while (fifo && !stopServing);
+    }
+
+    finish();
+    report(stderr);
+}
@@ -0,0 +1,137 @@
+/**
+ * \file online.h
+ * \author Kefei Lu
+ * \brief Classification of the flows of a live packet stream.
+ * \sa online.cpp, flow.h
+ */
+
+#ifndef __ONLINE_H__
+#define __ONLINE_H__
+
+#include "common.h"
+#include "flow.h"
+#include "compiledmodel.h"
+
+/**
+ * \brief A decision, as written in binary by OnlineClassifier.
+ *
+ * 32 bytes, in host byte order.
+ */
+struct FlowDecision {
+    uint64_t	time;		///< Of the last packet of the flow seen, in us.
+    uint32_t	client;
+    uint32_t	server;
+    uint16_t	clientPort;
+    uint16_t	serverPort;
+    uint32_t	label;		///< Index of the class value.
+    float	posterior;	///< Of the label.
+    uint32_t	packets;	///< The number of packets classified on.
+};
+
+/**
+ * \brief Classify the TCP flows of a TSH stream as it comes.
+ *
+ * The packets are tracked in a FlowTable. A flow is classified by a
+ *   CompiledModel once, as soon as it has first_n() packets, or when it
+ *   is completed with fewer. The model is trained on the rows of
+ *   FlowExtractor with the same first_n(), so that it sees the same
+ *   features.
+ *
+ * Each decision is written to output() as a line:
+ * \verbatim
+   time client:port server:port label posterior packets
+   \endverbatim
+ *   or, if binary(), as a FlowDecision.
+ *
+ * The throughput and the decision latency are measured: the latency
+ *   is the wall time from when the data of the deciding packet is
+ *   feed()'ed to when the decision is written.
+ */
+class OnlineClassifier {
+    private:
+	const CompiledModel&	_model;
+	FlowTable		_table;
+	size_t			_firstN;
+	bool			_binary;
+	FILE*			_out;
+	double			_reportEvery;
+
+	/** The bytes of a record split between two feed()'s. */
+	unsigned char		_partial[TshReader::RECORD];
+	size_t			_nPartial;
+	vector<TshPacket>	_block;
+	Instance		_inst;
+	vector<double>		_logL;
+
+	size_t			_nPacket;
+	size_t			_nEarly;	///< Decided at first_n() packets.
+	size_t			_nEnd;		///< Decided when completed.
+	double			_start;		///< Wall time of the first feed().
+	double			_busy;		///< Wall time spent in feed().
+	double			_arrival;	///< Wall time of this feed().
+	double			_lastReport;
+	/** Decision latencies, in microseconds. */
+	RunningMoments		_latency;
+	double			_maxLatency;
+	/** Trace time from the first packet of a flow to its decision, in
+	 * seconds. */
+	RunningMoments		_delay;
+
+	void packet(const TshPacket& p);
+	void decide(const Flow& f);
+	/** Drop the partial record at the end of a stream. */
+	void end_stream();
+	/** feed() what is read from fd, until its end or a stop signal. */
+	void serve_fd(const int fd);
+
+	// Not copyable.
+	OnlineClassifier(const OnlineClassifier&);
+	OnlineClassifier& operator=(const OnlineClassifier&);
+    public:
+	/** The number of packets a flow is classified on. 0: when it is
+	 * completed only. */
+	size_t& first_n() {return _firstN;}
+	const size_t& first_n() const {return _firstN;}
+	/** Write FlowDecision's rather than lines. */
+	bool& binary() {return _binary;}
+	const bool& binary() const {return _binary;}
+	/** Where the decisions are written, stdout by default. */
+	FILE*& output() {return _out;}
+	/** Seconds between the reports by serve(), 0 for none but the last. */
+	double& report_every() {return _reportEvery;}
+	FlowTable& table() {return _table;}
+	const FlowTable& table() const {return _table;}
+
+	/**
+	 * \brief Take the next bytes of the stream.
+	 *
+	 * They need not be a whole number of records. The decisions are
+	 *   written, and output() flushed.
+	 */
+	void feed(const char* data, const size_t n);
+	/** Classify the flows left, at the end of the last stream. */
+	void finish();
+
+	/**
+	 * \brief Read the stream from input until its end, or SIGINT or
+	 *   SIGTERM, then finish() and report().
+	 *
+	 * input is "-" for stdin, "unix:path" to listen on a Unix socket,
+	 *   the streams of the connections being read one after the
+	 *   other, or a file. A FIFO is opened again at its end.
+	 */
+	void serve(const char* input);
+
+	/** Report the throughput and the latencies. */
+	void report(FILE* fp) const;
+	size_t num_of_packet() const {return _nPacket;}
+	size_t num_of_decided() const {return _nEarly + _nEnd;}
+
+	/**
+	 * The model must be of the schema of FlowExtractor::make_schema()
+	 *   with classes. Exits otherwise.
+	 */
+	OnlineClassifier(const CompiledModel& model);
+};
+
+#endif
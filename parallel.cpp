@@ -0,0 +1,80 @@
+/**
+ * \file parallel.cpp
+ * \author Kefei Lu
+ * \brief Implementation of run_parallel() on pthreads.
+ * \sa parallel.h
+ */
+
+#include "parallel.h"
+using namespace std;
+
+#ifdef linux
+  #include <unistd.h>
+#endif
+
+size_t
+num_of_cpu()
+{
+#ifdef linux
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > 0) return n;
+#endif
+    return 1;
+}
+
+#ifdef linux
+/** What every worker thread shares. */
+struct JobQueue {
+    JobFunc	job;
+    void*	arg;
+    size_t	nJob;
+    size_t	next; ///< The next job to take, atomically.
+};
+
+static void*
+worker(void* q)
+{
+    JobQueue* queue = (JobQueue*)q;
+    while (1) {
+	size_t i = __sync_fetch_and_add(&queue->next, 1);
+	if (i >= queue->nJob) break;
+	queue->job(i, queue->arg);
+    }
+    return NULL;
+}
+#endif
+
+void
+run_parallel(JobFunc job, void* arg, const size_t nJob, size_t nThread)
+{
+    if (nThread == 0) nThread = num_of_cpu();
+    if (nThread > nJob) nThread = nJob;
+#ifdef linux
+    if (nThread > 1) {
+	JobQueue queue;
+	queue.job = job;
+	queue.arg = arg;
+	queue.nJob = nJob;
+	queue.next = 0;
+	// The calling thread works too.
+	vector<pthread_t> tid(nThread - 1);
+	size_t nStarted = 0;
+	for (size_t i=0; i<tid.size(); i++) {
+	    if (pthread_create(&tid[i], NULL, worker, &queue) != 0) {
+		fprintf(stderr, "(W) Can not create thread, "
+			"running with %lu.\n", (unsigned long)(nStarted+1));
+		break;
+	    }
+	    nStarted ++;
+	}
+	worker(&queue);
+	for (size_t i=0; i<nStarted; i++) {
+	    pthread_join(tid[i], NULL);
+	}
+	return;
+    }
+#endif
+    for (size_t i=0; i<nJob; i++) {
+	job(i, arg);
+    }
+}
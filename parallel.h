@@ -0,0 +1,64 @@
+/**
+ * \file parallel.h
+ * \author Kefei Lu
+ * \brief A minimal way to run independent jobs on several threads.
+ * \sa parallel.cpp
+ */
+
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+#include "common.h"
+
+#ifdef linux
+  #include <pthread.h>
+#endif
+
+/**
+ * \brief A job function.
+ *
+ * Does the i-th job. arg is the same pointer given to run_parallel() 
+ *   for every job, so jobs must only write to their own part of it.
+ */
+typedef void (*JobFunc)(const size_t i, void* arg);
+
+/** \brief Get the number of online processors, at least 1. */
+size_t num_of_cpu();
+
+/**
+ * \brief Run job(i, arg) for every i in [0, nJob).
+ *
+ * The jobs are taken in order by up to nThread worker threads, and the 
+ *   call returns when all of them are done. nThread 0 means one thread 
+ *   per processor (num_of_cpu()). With one thread, or without pthreads, 
+ *   the jobs simply run in order in the calling thread.
+ */
+void run_parallel(JobFunc job, void* arg, const size_t nJob, size_t nThread);
+
+/**
+ * \brief A mutual exclusion lock.
+ *
+ * Without pthreads there is only one thread, and it does nothing.
+ */
+class Mutex {
+    private:
+#ifdef linux
+	pthread_mutex_t	_m;
+#endif
+	// Not copyable.
+	Mutex(const Mutex&);
+	Mutex& operator=(const Mutex&);
+    public:
+#ifdef linux
+	Mutex() {pthread_mutex_init(&_m, NULL);}
+	~Mutex() {pthread_mutex_destroy(&_m);}
+	void lock() {pthread_mutex_lock(&_m);}
+	void unlock() {pthread_mutex_unlock(&_m);}
+#else
+	Mutex() {}
+	void lock() {}
+	void unlock() {}
+#endif
+};
+
+#endif
@@ -0,0 +1,327 @@
+/**
+ * \file pcap.cpp
+ * \author Kefei Lu
+ * \brief Implementation of PcapReader.
+ * \sa pcap.h
+ */
+
+#include "pcap.h"
+using namespace std;
+
+// Magic numbers, as read in the byte order of the writer.
+static const uint32_t PCAP_MAGIC = 0xa1b2c3d4;
+static const uint32_t PCAP_MAGIC_NANO = 0xa1b23c4d;
+static const uint32_t PCAPNG_SECTION = 0x0a0d0d0a;
+static const uint32_t PCAPNG_BYTE_ORDER = 0x1a2b3c4d;
+
+// pcap-ng block types.
+static const uint32_t PCAPNG_INTERFACE = 1;
+static const uint32_t PCAPNG_SIMPLE_PACKET = 3;
+static const uint32_t PCAPNG_ENHANCED_PACKET = 6;
+
+static const uint16_t ETHERTYPE_IPV4 = 0x0800;
+static const uint16_t ETHERTYPE_VLAN = 0x8100;
+static const uint16_t ETHERTYPE_QINQ = 0x88a8;
+
+static inline uint32_t
+swap32(const uint32_t x)
+{
+    return x >> 24 | (x >> 8 & 0xff00) | (x << 8 & 0xff0000) | x << 24;
+}
+
+/** A host order integer at p, which may not be aligned. */
+static inline uint32_t
+load32(const unsigned char* p)
+{
+    uint32_t x;
+    memcpy(&x, p, 4);
+    return x;
+}
+
+inline uint16_t
+PcapReader::
+get16(const unsigned char* p) const
+{
+    uint16_t x;
+    memcpy(&x, p, 2);
+    return _swap ? (uint16_t)(x >> 8 | x << 8) : x;
+}
+
+inline uint32_t
+PcapReader::
+get32(const unsigned char* p) const
+{
+    const uint32_t x = load32(p);
+    return _swap ? swap32(x) : x;
+}
+
+/** A timestamp of units a second, in microseconds. */
+static inline uint64_t
+to_us(const uint64_t t, const uint64_t units)
+{
+    if (units == 1000000) return t;
+    if (units % 1000000 == 0) return t / (units / 1000000);
+    return (uint64_t)(t * (1e6 / units));
+}
+
+bool
+PcapReader::
+is_pcap(const char* file)
+{
+    FILE* fp = fopen(file, "rb");
+    if (!fp) return 0;
+    unsigned char b[4];
+    const bool read = fread(b, 1, 4, fp) == 4;
+    fclose(fp);
+    if (!read) return 0;
+    const uint32_t m = load32(b);
+    return m == PCAP_MAGIC || m == swap32(PCAP_MAGIC)
+	|| m == PCAP_MAGIC_NANO || m == swap32(PCAP_MAGIC_NANO)
+	|| m == PCAPNG_SECTION;
+}
+
+PcapReader::
+PcapReader(const char* pcap_file) :
+    _ng(0), _swap(0), _linkType(0), _tsUnits(1000000),
+    _nFrame(0), _nSkipped(0), _nTruncated(0)
+{
+    fprintf( stdout, "(I) Opening capture file: %s...\n", pcap_file );
+    if (_file.open(pcap_file) != 0) {
+	fprintf(stderr, "(E) Opening file %s failed.\n", pcap_file);
+	exit(1);
+    }
+    _p = (const unsigned char*)_file.data();
+    _end = _p + _file.size();
+    const uint32_t m = _file.size() >= 24 ? load32(_p) : 0;
+    if (m == PCAPNG_SECTION) {
+	// The blocks are read by next(), starting with this one.
+	_ng = 1;
+    } else if (m == PCAP_MAGIC || m == swap32(PCAP_MAGIC)
+	    || m == PCAP_MAGIC_NANO || m == swap32(PCAP_MAGIC_NANO)) {
+	_swap = m == swap32(PCAP_MAGIC) || m == swap32(PCAP_MAGIC_NANO);
+	_tsUnits = get32(_p) == PCAP_MAGIC_NANO ? 1000000000 : 1000000;
+	// The upper bits may tell about the FCS.
+	_linkType = get32(_p+20) & 0xffff;
+	_p += 24;
+    } else {
+	fprintf(stderr, "(E) %s is not a pcap or pcap-ng file.\n", pcap_file);
+	exit(1);
+    }
+}
+
+void
+PcapReader::
+section(const unsigned char* b, const size_t size)
+{
+    if (size < 28 || get16(b+12) != 1) {
+	fprintf(stderr, "(E) Unsupported pcap-ng section, version %d.\n",
+		size < 28 ? 0 : (int)get16(b+12));
+	exit(1);
+    }
+    // The interfaces are numbered from 0 in each section.
+    _ifLinkType.clear();
+    _ifTsUnits.clear();
+    _ifSnapLen.clear();
+}
+
+void
+PcapReader::
+interface(const unsigned char* b, const size_t size)
+{
+    if (size < 20) return;
+    _ifLinkType.push_back(get16(b+8));
+    _ifSnapLen.push_back(get32(b+12));
+    uint64_t units = 1000000;
+    // The options, each padded to 4 bytes, up to the trailing length.
+    const unsigned char* o = b + 16;
+    const unsigned char* end = b + size - 4;
+    while (o + 4 <= end) {
+	const uint16_t code = get16(o);
+	const uint16_t len = get16(o+2);
+	if (code == 0 || o + 4 + len > end) break;
+	if (code == 9 && len >= 1) {
+	    // if_tsresol: a negative power of 10, or of 2 if the MSB is set.
+	    const unsigned v = o[4];
+	    units = 1;
+	    if (v & 0x80) {
+		units <<= (v & 0x7f);
+	    } else {
+		for (unsigned i=0;i<v;i++) units *= 10;
+	    }
+	}
+	o += 4 + ((len + 3) & ~3);
+    }
+    _ifTsUnits.push_back(units);
+}
+
+bool
+PcapReader::
+parse_frame(const unsigned char* data, const size_t capLen,
+	const size_t origLen, const uint32_t linkType, TshPacket& p,
+	bool& truncated)
+{
+    truncated = 0;
+    size_t off;
+    switch (linkType) {
+	case LINK_ETHERNET: {
+	    if (capLen < 14) return 0;
+	    uint16_t type = be16(data+12);
+	    off = 14;
+	    // 802.1Q and 802.1ad tags.
+	    while ((type == ETHERTYPE_VLAN || type == ETHERTYPE_QINQ)
+		    && capLen >= off+4) {
+		type = be16(data+off+2);
+		off += 4;
+	    }
+	    if (type != ETHERTYPE_IPV4) return 0;
+	    break;
+	}
+	case LINK_LINUX_SLL:
+	    if (capLen < 16 || be16(data+14) != ETHERTYPE_IPV4) return 0;
+	    off = 16;
+	    break;
+	case LINK_RAW:
+	case LINK_IPV4:
+	    off = 0;
+	    break;
+	default:
+	    return 0;
+    }
+
+    const unsigned char* ip = data + off;
+    if (capLen < off + 20) {
+	truncated = capLen > off && ip[0] >> 4 == 4;
+	return 0;
+    }
+    if (ip[0] >> 4 != 4) return 0;
+    TshReader::decode_ip(ip, p);
+    if (p.ipHeaderLen < 20) return 0;
+    // Offloaded segments may leave the total length 0.
+    if (p.length == 0 && origLen > off) {
+	p.length = (uint16_t)min(origLen - off, (size_t)0xffff);
+    }
+
+    if (p.protocol != IP_PROTO_TCP || p.fragOffset) {
+	p.sport = p.dport = 0;
+	p.seq = p.ack = 0;
+	p.tcpHeaderLen = p.flags = 0;
+	p.window = 0;
+	return 1;
+    }
+    if (capLen < off + p.ipHeaderLen + 16) {
+	truncated = 1;
+	return 0;
+    }
+    TshReader::decode_tcp(ip + p.ipHeaderLen, p);
+    return 1;
+}
+
+inline bool
+PcapReader::
+frame(const unsigned char* data, const size_t capLen, const size_t origLen,
+	const uint32_t linkType, const uint64_t time, const uint32_t iface,
+	TshPacket& p)
+{
+    _nFrame ++;
+    bool truncated;
+    if (!parse_frame(data, capLen, origLen, linkType, p, truncated)) {
+	if (truncated) _nTruncated ++;
+	else _nSkipped ++;
+	return 0;
+    }
+    p.time = time;
+    p.iface = iface;
+    return 1;
+}
+
+size_t
+PcapReader::
+next(TshPacket* out, const size_t n)
+{
+    size_t m = 0;
+    while (m < n && _p < _end) {
+	const size_t left = _end - _p;
+	if (!_ng) {
+	    if (left < 16 || get32(_p+8) > left - 16) {
+		fprintf(stderr, "(W) The capture ends with a truncated "
+			"frame, left out.\n");
+		_p = _end;
+		break;
+	    }
+	    const uint64_t t = (uint64_t)get32(_p) * _tsUnits + get32(_p+4);
+	    const size_t capLen = get32(_p+8);
+	    const size_t origLen = get32(_p+12);
+	    const unsigned char* data = _p + 16;
+	    _p = data + capLen;
+	    if (frame(data, capLen, origLen, _linkType, to_us(t, _tsUnits), 0,
+			out[m])) {
+		m ++;
+	    }
+	    continue;
+	}
+
+	if (left < 12) {
+	    fprintf(stderr, "(W) The capture ends with a truncated block, "
+		    "left out.\n");
+	    _p = _end;
+	    break;
+	}
+	const uint32_t type = load32(_p);
+	if (type == PCAPNG_SECTION) {
+	    // Its byte order is that of the section it starts.
+	    const uint32_t bom = load32(_p+8);
+	    if (bom != PCAPNG_BYTE_ORDER && bom != swap32(PCAPNG_BYTE_ORDER)) {
+		fprintf(stderr, "(E) Corrupted pcap-ng section header.\n");
+		exit(1);
+	    }
+	    _swap = bom != PCAPNG_BYTE_ORDER;
+	}
+	const size_t size = get32(_p+4);
+	if (size < 12 || size % 4 || size > left) {
+	    fprintf(stderr, "(W) The capture ends with a corrupted or "
+		    "truncated block, left out.\n");
+	    _p = _end;
+	    break;
+	}
+	const unsigned char* b = _p;
+	_p += size;
+	switch (get32(b)) {
+	    case PCAPNG_SECTION:
+		section(b, size);
+		break;
+	    case PCAPNG_INTERFACE:
+		interface(b, size);
+		break;
+	    case PCAPNG_ENHANCED_PACKET: {
+		if (size < 32) break;
+		const uint32_t iface = get32(b+8);
+		const size_t capLen = get32(b+20);
+		if (iface >= _ifLinkType.size() || capLen > size - 32) {
+		    _nFrame ++;
+		    _nSkipped ++;
+		    break;
+		}
+		const uint64_t t = (uint64_t)get32(b+12) << 32 | get32(b+16);
+		if (frame(b+28, capLen, get32(b+24), _ifLinkType[iface],
+			    to_us(t, _ifTsUnits[iface]), iface, out[m])) {
+		    m ++;
+		}
+		break;
+	    }
+	    case PCAPNG_SIMPLE_PACKET: {
+		// Of interface 0, with no timestamp.
+		if (size < 16 || _ifLinkType.empty()) break;
+		const size_t origLen = get32(b+8);
+		size_t capLen = min(origLen, size - 16);
+		if (_ifSnapLen[0]) capLen = min(capLen, (size_t)_ifSnapLen[0]);
+		if (frame(b+12, capLen, origLen, _ifLinkType[0], 0, 0, out[m])) {
+		    m ++;
+		}
+		break;
+	    }
+	    default:
+		break;
+	}
+    }
+    return m;
+}
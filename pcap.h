@@ -0,0 +1,111 @@
+/**
+ * \file pcap.h
+ * \author Kefei Lu
+ * \brief Reader of pcap and pcap-ng capture files, without libpcap.
+ * \sa pcap.cpp, tsh.h
+ */
+
+#ifndef __PCAP_H__
+#define __PCAP_H__
+
+#include "common.h"
+#include "mappedfile.h"
+#include "tsh.h"
+
+/** The link types of the frames parse_frame() knows. */
+enum LinkType {
+    LINK_ETHERNET = 1,
+    LINK_RAW = 101,		///< Raw IP.
+    LINK_LINUX_SLL = 113,	///< Linux "cooked" capture.
+    LINK_IPV4 = 228		///< Raw IPv4.
+};
+
+/**
+ * \brief A pcap or pcap-ng capture file, read in place.
+ *
+ * The file is mapped into memory (MappedFile) and walked frame by
+ *   frame; the headers are parsed right in the mapping, into the
+ *   TshPacket's of the IPv4 packets, which feed the flows as those of a
+ *   TSH trace (FlowExtractor). Both byte orders are read, and in pcap-ng
+ *   the Enhanced and Simple Packet Blocks, with the link type and
+ *   timestamp resolution of their interface. Other frames and blocks
+ *   are skipped.
+ *
+ * The packets may have been truncated at the snap length. The sizes are
+ *   taken from the IP header, not from the bytes captured; a packet is
+ *   only skipped if its IP header, or the first 16 bytes of its TCP
+ *   header, are not all there.
+ */
+class PcapReader {
+    private:
+	MappedFile	_file;
+	const unsigned char* _p;	///< The next frame or block.
+	const unsigned char* _end;
+	bool		_ng;
+	/** If the numbers of the file (section) are of the other byte
+	 * order. */
+	bool		_swap;
+
+	/** pcap: the link type, and the number of timestamp units a
+	 * second (10^6, or 10^9 for nanoseconds). */
+	uint32_t	_linkType;
+	uint64_t	_tsUnits;
+	/** pcap-ng: those of each interface of the section. */
+	std::vector<uint32_t> _ifLinkType;
+	std::vector<uint64_t> _ifTsUnits;
+	std::vector<uint32_t> _ifSnapLen;
+
+	size_t		_nFrame;
+	size_t		_nSkipped;
+	size_t		_nTruncated;
+
+	uint16_t get16(const unsigned char* p) const;
+	uint32_t get32(const unsigned char* p) const;
+	/** Read a pcap-ng Section Header or Interface Description Block. */
+	void section(const unsigned char* block, const size_t size);
+	void interface(const unsigned char* block, const size_t size);
+	/** Parse a frame, counting it. \return 1 if p is set. */
+	bool frame(const unsigned char* data, const size_t capLen,
+		const size_t origLen, const uint32_t linkType,
+		const uint64_t time, const uint32_t iface, TshPacket& p);
+
+	// Not copyable.
+	PcapReader(const PcapReader&);
+	PcapReader& operator=(const PcapReader&);
+    public:
+	/** Whether a file starts as a pcap or pcap-ng one. */
+	static bool is_pcap(const char* file);
+
+	/**
+	 * \brief Parse the link, IPv4 and TCP headers of a frame.
+	 *
+	 * \param capLen The bytes captured at data.
+	 * \param origLen The bytes of the frame on the wire.
+	 * \param truncated Set to whether the frame is an IPv4 one, but
+	 *   too short to parse.
+	 * \return 1 if p is set: the frame is an IPv4 packet. time and
+	 *   iface are left to the caller.
+	 */
+	static bool parse_frame(const unsigned char* data, const size_t capLen,
+		const size_t origLen, const uint32_t linkType, TshPacket& p,
+		bool& truncated);
+
+	/** Map a capture file. Exits if it cannot be read or is not one. */
+	PcapReader(const char* pcap_file);
+
+	/**
+	 * \brief Read the IPv4 packets of the next frames.
+	 *
+	 * \return The number read into out, at most n, 0 at the end.
+	 */
+	size_t next(TshPacket* out, const size_t n);
+
+	/** The number of frames read so far. */
+	size_t num_of_frame() const {return _nFrame;}
+	/** Of which not IPv4, or of an unknown link type. */
+	size_t num_of_skipped() const {return _nSkipped;}
+	/** Of which too truncated to parse. */
+	size_t num_of_truncated() const {return _nTruncated;}
+};
+
+#endif
@@ -9,17 +9,127 @@
 #include "dataset.h"
 #include "classifier.h"
 #include "xvalidator.h"
+#include "fcbf.h"
+#include "flow.h"
+#include "online.h"
+#include <unistd.h>
 
 /** Only use the attributes which are proved to be more important. */
 #define __ONLY_USE_THESE_ATT__
+/** Or select them by FCBF on the whole dataset. */
+//#define __FCBF_SELECT__
 
 using namespace std;
 
-int main()
+static int
+usage()
 {
+    fprintf(stderr,
+	    "Usage: nb4it\n"
+	    "         Cross validate on test.arff.\n"
+	    "       nb4it -extract trace flows.arff [-n N] [class ...]\n"
+	    "         Write the features of the flows of a TSH trace or a pcap\n"
+	    "         or pcap-ng capture, on their first N packets, with an\n"
+	    "         unknown class of these values.\n"
+	    "       nb4it -train data.arff class_index model\n"
+	    "         Train on all the attributes and save the model.\n"
+	    "       nb4it -serve model [-n N] [-b] [-i input] [-o output] [-r sec]\n"
+	    "         Classify the flows of a TSH stream on their first N\n"
+	    "         packets (default 5). input is - (default), a file or\n"
+	    "         FIFO, or unix:path; -b writes binary decisions; -r\n"
+	    "         reports every sec seconds.\n");
+    return 1;
+}
+
+static int
+extract_main(int argc, char** argv)
+{
+    if (argc < 4) return usage();
+    size_t firstN = 0;
+    vector<string> classes;
+    for (int i=4;i<argc;i++) {
+	if (strcmp(argv[i], "-n") == 0 && i+1 < argc) {
+	    firstN = atoi(argv[++i]);
+	} else {
+	    classes.push_back(argv[i]);
+	}
+    }
+    Dataset ds;
+    FlowExtractor::make_schema(ds, classes);
+    extract_flows(argv[2], ds, firstN);
+    ds.save_arff(argv[3]);
+    return 0;
+}
+
+static int
+train_main(int argc, char** argv)
+{
+    if (argc != 5) return usage();
+    Dataset ds(argv[2]);
+    NaiveBayesClassifier c(ds, atoi(argv[3]));
+    c.train();
+    CompiledModel(c).save(argv[4]);
+    fprintf(stdout, "(I) Saved the model to %s.\n", argv[4]);
+    return 0;
+}
+
+static int
+serve_main(int argc, char** argv)
+{
+    if (argc < 3) return usage();
+    size_t firstN = 5;
+    bool binary = 0;
+    double reportEvery = 0;
+    const char* input = "-";
+    const char* output = NULL;
+    for (int i=3;i<argc;i++) {
+	const bool arg = i+1 < argc;
+	if (strcmp(argv[i], "-n") == 0 && arg) firstN = atoi(argv[++i]);
+	else if (strcmp(argv[i], "-b") == 0) binary = 1;
+	else if (strcmp(argv[i], "-i") == 0 && arg) input = argv[++i];
+	else if (strcmp(argv[i], "-o") == 0 && arg) output = argv[++i];
+	else if (strcmp(argv[i], "-r") == 0 && arg) reportEvery = atof(argv[++i]);
+	else return usage();
+    }
+    FILE* out;
+    if (output) {
+	out = fopen(output, binary ? "wb" : "w");
+	if (!out) {
+	    fprintf(stderr, "(E) Opening file %s failed.\n", output);
+	    return 1;
+	}
+    } else {
+	// The decisions go to stdout alone: the messages to stderr.
+	fflush(stdout);
+	out = fdopen(dup(1), binary ? "wb" : "w");
+	dup2(2, 1);
+    }
+
+    const CompiledModel model(argv[2]);
+    OnlineClassifier online(model);
+    online.first_n() = firstN;
+    online.binary() = binary;
+    online.report_every() = reportEvery;
+    online.output() = out;
+    online.serve(input);
+    fclose(out);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1) {
+	if (strcmp(argv[1], "-extract") == 0) return extract_main(argc, argv);
+	if (strcmp(argv[1], "-train") == 0) return train_main(argc, argv);
+	if (strcmp(argv[1], "-serve") == 0) return serve_main(argc, argv);
+	return usage();
+    }
+
     Dataset dataset("test.arff");
 
     NaiveBayesClassifier c(dataset,248);
+    // NaiveBayesClassifierKernel c(dataset,248);
+    // NaiveBayesClassifierDiscrete c(dataset,248);
 
 #ifdef __ONLY_USE_THESE_ATT__
     /* Only use the attributes which are proved to be more important. */
@@ -28,6 +138,10 @@ int main()
     // size_t use_these[] = {60, 95, 96, 86, 162, 45, 180, 83, 113, 59};
     c.only_these_att().assign(use_these, use_these + sizeof(use_these)/sizeof(size_t));
     c.useAllAtt() = 0;
+#elif defined(__FCBF_SELECT__)
+    FcbfSelector fcbf;
+    c.only_these_att() = fcbf.select(dataset, c.class_index());
+    c.useAllAtt() = 0;
 #endif
 
     // Cross validation:
@@ -0,0 +1,81 @@
+/**
+ * \file tsh.cpp
+ * \author Kefei Lu
+ * \brief Implementation of TshReader.
+ * \sa tsh.h
+ */
+
+#include "tsh.h"
+using namespace std;
+
+const size_t TshReader::RECORD;
+
+TshReader::
+TshReader(const char* tsh_file)
+{
+    fprintf( stdout, "(I) Opening trace file: %s...\n", tsh_file );
+    if (_file.open(tsh_file) != 0) {
+	fprintf(stderr, "(E) Opening file %s failed.\n", tsh_file);
+	exit(1);
+    }
+    _nPacket = _file.size() / RECORD;
+    if (_file.size() % RECORD) {
+	fprintf(stderr, "(W) %s ends with a truncated record, "
+		"left out.\n", tsh_file);
+    }
+    fprintf( stdout, "(I) Read %d packets.\n", (int)_nPacket );
+}
+
+void
+TshReader::
+decode_ip(const unsigned char* ip, TshPacket& p)
+{
+    p.ipVersion = ip[0] >> 4;
+    p.ipHeaderLen = (ip[0] & 0x0f) * 4;
+    p.tos = ip[1];
+    p.length = be16(ip+2);
+    p.id = be16(ip+4);
+    p.ipFlags = ip[6] >> 5;
+    p.fragOffset = be16(ip+6) & 0x1fff;
+    p.ttl = ip[8];
+    p.protocol = ip[9];
+    p.src = be32(ip+12);
+    p.dst = be32(ip+16);
+}
+
+void
+TshReader::
+decode_tcp(const unsigned char* tcp, TshPacket& p)
+{
+    p.sport = be16(tcp);
+    p.dport = be16(tcp+2);
+    p.seq = be32(tcp+4);
+    p.ack = be32(tcp+8);
+    p.tcpHeaderLen = (tcp[12] >> 4) * 4;
+    p.flags = tcp[13] & 0x3f;
+    p.window = be16(tcp+14);
+}
+
+void
+TshReader::
+decode(const unsigned char* r, TshPacket& p)
+{
+    // Time: seconds, then the interface and 24 bits of microseconds.
+    p.time = (uint64_t)be32(r) * 1000000 + (be32(r+4) & 0xffffff);
+    p.iface = r[4];
+    decode_ip(r + 8, p);
+    decode_tcp(r + 28, p);
+}
+
+size_t
+TshReader::
+decode(const size_t first, const size_t n, TshPacket* out) const
+{
+    if (first >= _nPacket) return 0;
+    const size_t m = min(n, _nPacket - first);
+    const unsigned char* r = (const unsigned char*)_file.data() + first*RECORD;
+    for (size_t i=0;i<m;i++, r+=RECORD) {
+	decode(r, out[i]);
+    }
+    return m;
+}
@@ -0,0 +1,119 @@
+/**
+ * \file tsh.h
+ * \author Kefei Lu
+ * \brief Reader of TSH (time sequenced headers) packet traces.
+ * \sa tsh.cpp, README for the record format.
+ */
+
+#ifndef __TSH_H__
+#define __TSH_H__
+
+#include "common.h"
+#include "mappedfile.h"
+
+/** TCP flags, in TshPacket::flags. */
+enum TcpFlag {
+    TCP_FIN = 0x01,
+    TCP_SYN = 0x02,
+    TCP_RST = 0x04,
+    TCP_PSH = 0x08,
+    TCP_ACK = 0x10,
+    TCP_URG = 0x20
+};
+
+/** The protocol number of TCP in the IP header. */
+#define IP_PROTO_TCP 6
+
+/** A big endian (network byte order) integer at p. */
+inline uint16_t
+be16(const unsigned char* p)
+{
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+inline uint32_t
+be32(const unsigned char* p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+/**
+ * \brief A packet of a trace: the fields of its IP and TCP headers.
+ *
+ * The addresses and all the other fields are in host byte order. The
+ *   TCP fields are only meaningful if protocol is IP_PROTO_TCP.
+ */
+struct TshPacket {
+    /** Timestamp, in microseconds. */
+    uint64_t	time;
+    uint8_t	iface;		///< Interface number.
+
+    uint8_t	ipVersion;
+    uint8_t	ipHeaderLen;	///< In bytes.
+    uint8_t	tos;
+    uint16_t	length;		///< IP total length, in bytes.
+    uint16_t	id;
+    uint8_t	ipFlags;	///< The 3 flag bits.
+    uint16_t	fragOffset;	///< In 8 byte units.
+    uint8_t	ttl;
+    uint8_t	protocol;
+    uint32_t	src;
+    uint32_t	dst;
+
+    uint16_t	sport;
+    uint16_t	dport;
+    uint32_t	seq;
+    uint32_t	ack;
+    uint8_t	tcpHeaderLen;	///< In bytes.
+    uint8_t	flags;		///< TcpFlag's.
+    uint16_t	window;
+
+    /** The bytes of TCP payload, 0 if the headers claim more than length. */
+    size_t payload() const
+    {
+	const size_t h = (size_t)ipHeaderLen + tcpHeaderLen;
+	return length > h ? length - h : 0;
+    }
+};
+
+/**
+ * \brief A TSH trace file, read in place.
+ *
+ * The file is a sequence of 44 byte records: the timestamp and the
+ *   interface, the IP header without options, and the first 16 bytes of
+ *   the TCP header, all in network byte order. It is mapped into memory
+ *   (MappedFile), and the records decoded in blocks by decode().
+ */
+class TshReader {
+    private:
+	MappedFile	_file;
+	size_t		_nPacket;
+
+	// Not copyable.
+	TshReader(const TshReader&);
+	TshReader& operator=(const TshReader&);
+    public:
+	/** The size of a record, in bytes. */
+	static const size_t RECORD = 44;
+
+	/** Map a trace file. Exits if it cannot be read. */
+	TshReader(const char* tsh_file);
+
+	/** The number of records. A truncated last one is left out. */
+	size_t num_of_packet() const {return _nPacket;}
+
+	/** Decode one record. */
+	static void decode(const unsigned char* record, TshPacket& p);
+	/** Decode an IP header, but its options, into p. */
+	static void decode_ip(const unsigned char* ip, TshPacket& p);
+	/** Decode the first 16 bytes of a TCP header into p. */
+	static void decode_tcp(const unsigned char* tcp, TshPacket& p);
+	/**
+	 * \brief Decode the records [first, first+n).
+	 *
+	 * \return The number decoded into out, fewer at the end of the file.
+	 */
+	size_t decode(const size_t first, const size_t n, TshPacket* out) const;
+};
+
+#endif
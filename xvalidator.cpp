@@ -5,6 +5,7 @@
  */
 #include "common.h"
 #include "xvalidator.h"
+#include "parallel.h"
 
 #define __XVALIDATOR_DEBUG__
 
@@ -13,6 +14,8 @@ Xvalidator(Classifier* c, const size_t f, RSeed s)
 {
     _binded_classifier = c;
     seed() = s;
+    merge_folds() = 1;
+    n_thread() = 1;
     set_fold(f);
     init_randomIndex();
 }
@@ -99,6 +102,107 @@ vector<double>& vector_sum(vector<double>& v1, const vector<size_t>& v2)
     return v1;
 }
 
+void
+Xvalidator::
+collect(NaiveBayesStatistics& stat, const Classifier& c, 
+	const size_t foldi) const
+{
+    stat.init(c.dataset(), c.class_index());
+    stat.add(c.dataset(), randomIndecs().at(foldi));
+}
+
+void
+Xvalidator::
+run_fold(Classifier& c, const size_t foldi, 
+	const vector<NaiveBayesStatistics>* foldStat) const
+{
+    const size_t nInst = c.dataset().num_of_inst();
+    c.test_set().clear();
+    c.train_set().clear();
+    // assign test set.
+    c.test_set() = randomIndecs().at(foldi);
+    //assign train set.
+    c.train_set().resize(nInst-c.test_set().size());
+    vector<size_t>::iterator it = c.train_set().begin();
+    for (size_t i=0; i<fold(); i++) { // for each fold
+	if (i==foldi) continue;
+	const vector<size_t> & curFold = randomIndecs().at(i);
+	copy( curFold.begin(), curFold.end(), it );
+	it += curFold.size();
+    }
+    NaiveBayesClassifier* nb = dynamic_cast<NaiveBayesClassifier*>(&c);
+    if (nb && nb->additive()) {
+	// The other folds merged in fold order, the same numbers whether 
+	// collected now or before.
+	NaiveBayesStatistics stat, other;
+	stat.init(c.dataset(), c.class_index());
+	for (size_t i=0; i<fold(); i++) {
+	    if (i==foldi) continue;
+	    if (foldStat) {
+		stat += foldStat->at(i);
+	    } else {
+		collect(other, c, i);
+		stat += other;
+	    }
+	}
+	nb->train(stat);
+    } else {
+	c.train();
+    }
+    c.test();
+}
+
+/** The performance on a fold. */
+struct FoldResult {
+    double		accuracy;
+    vector<double>	trust;
+    ConfMatr		conf;
+};
+
+/** Everything the fold threads share. */
+struct FoldJobs {
+    const Xvalidator*		x;
+    /** Use the binded classifier instead of clones (one thread). */
+    bool			inPlace;
+    const vector<NaiveBayesStatistics>*	foldStat;
+    vector<FoldResult>		result;
+};
+
+/** The statistics of each fold, collected by the threads. */
+struct CollectJobs {
+    const Xvalidator*			x;
+    const Classifier*			c;
+    vector<NaiveBayesStatistics>*	stat;
+};
+
+static void
+collect_job(const size_t i, void* arg)
+{
+    CollectJobs* jobs = (CollectJobs*)arg;
+    jobs->x->collect(jobs->stat->at(i), *jobs->c, i);
+}
+
+static void
+fold_job(const size_t i, void* arg)
+{
+    FoldJobs* jobs = (FoldJobs*)arg;
+    Classifier* c = &jobs->x->classifier();
+    if (!jobs->inPlace) {
+	// The folds are already in parallel.
+	c = c->clone();
+	c->n_thread() = 1;
+    }
+    fprintf(stdout, "(I) Cross validating on progress: %d of %d...\n",
+	    (int)i+1, (int)jobs->x->fold());
+    jobs->x->run_fold(*c, i, jobs->foldStat);
+    // stores the performance:
+    FoldResult& r = jobs->result[i];
+    r.accuracy = c->accuracy();
+    r.trust = c->trust();
+    r.conf = c->conf();
+    if (!jobs->inPlace) delete c;
+}
+
 void 
 Xvalidator::
 xvalidate()
@@ -106,7 +210,6 @@ xvalidate()
     srand(seed());
     randomize();
     Classifier& c = classifier();
-    const size_t nInst = c.dataset().num_of_inst();
     const size_t nClass = c.get_class_desc().possible_value_vector().size();
 
     // Performance tmp:
@@ -117,30 +220,35 @@ xvalidate()
     vector< vector<double> > sum_conf(nClass, vector<double>(nClass,0)); // sum of conf mat.
     vector< vector<double> > ave_conf(nClass, vector<double>(nClass,0));
 
+    size_t nThread = n_thread() ? n_thread() : num_of_cpu();
+    if (nThread > fold()) nThread = fold();
+
+    const NaiveBayesClassifier* nb = dynamic_cast<NaiveBayesClassifier*>(&c);
+    vector<NaiveBayesStatistics> foldStat;
+    if (merge_folds() && nb && nb->additive()) {
+	fprintf(stdout, "(I) Collecting the statistics of each fold...\n");
+	foldStat.resize(fold());
+	CollectJobs collectJobs;
+	collectJobs.x = this;
+	collectJobs.c = &c;
+	collectJobs.stat = &foldStat;
+	run_parallel(collect_job, &collectJobs, fold(), nThread);
+    }
+
+    FoldJobs jobs;
+    jobs.x = this;
+    jobs.inPlace = nThread <= 1;
+    jobs.foldStat = foldStat.empty() ? NULL : &foldStat;
+    jobs.result.resize(fold());
+    run_parallel(fold_job, &jobs, fold(), nThread);
+
     for (size_t foldi = 0; foldi<fold(); foldi++) {
-	fprintf(stdout, "(I) Cross validating on progress: %d of %d...\n",
-		foldi+1, fold());
-	c.test_set().clear();
-	c.train_set().clear();
-	// assign test set.
-	c.test_set() = randomIndecs().at(foldi);
-	//assign train set.
-	c.train_set().resize(nInst-c.test_set().size());
-	vector<size_t>::iterator it = c.train_set().begin();
-	for (size_t i=0; i<fold(); i++) { // for each fold
-	    if (i==foldi) continue;
-	    const vector<size_t> & curFold = randomIndecs().at(i);
-	    copy( curFold.begin(), curFold.end(), it );
-	    it += curFold.size();
-	}
-	c.train();
-	c.test();
-	// stores the performance:
-	sum_acc += c.accuracy();
+	const FoldResult& r = jobs.result[foldi];
+	sum_acc += r.accuracy;
 	transform ( sum_trust.begin(), sum_trust.end(),
-		c.trust().begin(), sum_trust.begin(), double_sum );
+		r.trust.begin(), sum_trust.begin(), double_sum );
 	transform ( sum_conf.begin(), sum_conf.end(),
-		c.conf().begin(), sum_conf.begin(), vector_sum );
+		r.conf.begin(), sum_conf.begin(), vector_sum );
     }
     // average on the performance:
     ave_acc = sum_acc/fold();
@@ -18,6 +18,15 @@ class Xvalidator {
 	RSeed		_seed;
 	Classifier *	_binded_classifier;
 	size_t		_fold;
+	/** If the statistics of each fold are collected once and merged 
+	 * into the train sets of the others, default yes.
+	 *
+	 * \sa xvalidate() */
+	bool		_mergeFolds;
+	/** Number of threads running the folds, default 1.
+	 *
+	 * \sa xvalidate() */
+	size_t		_nThread;
 
 	/** Randomized instance indecs. 
 	 *
@@ -29,6 +38,11 @@ class Xvalidator {
 	const RSeed& seed() const {return _seed;}
 	Classifier & classifier() const {return *_binded_classifier;}
 	const size_t & fold() const {return _fold;}
+	bool& merge_folds() {return _mergeFolds;}
+	const bool& merge_folds() const {return _mergeFolds;}
+	/** Get/set the number of threads, 0 for one per processor. */
+	size_t& n_thread() {return _nThread;}
+	const size_t& n_thread() const {return _nThread;}
 	/** Re assign a fold.
 	 *
 	 * This will call init_randomIndex() to re-init. the vector sizes.
@@ -56,7 +70,40 @@ class Xvalidator {
 	 * process, but NOT during the process. */
 	void randomize();
 
+	/** Cross validate the classifier.
+	 *
+	 * If the classifier is an additive NaiveBayesClassifier, the 
+	 * model of each fold is estimated from the statistics 
+	 * (NaiveBayesStatistics) of the other folds, merged in fold order. 
+	 * With merge_folds() set, the statistics of each fold are collected 
+	 * once, so the values are added once in all, instead of once per 
+	 * fold they are trained on; left off, they are collected again for 
+	 * each fold. Both give the same numbers, bit for bit. They may 
+	 * differ from those of train() on the whole train set by rounding 
+	 * of the merge, a relative 1e-12 or so for well scaled data.
+	 *
+	 * With more than one thread (n_thread()), the folds run in 
+	 * parallel, each on a private clone of the classifier 
+	 * (Classifier::clone()), and the performances are averaged in fold 
+	 * order, so the result is the same as with one thread. With one 
+	 * thread, the binded classifier itself is used, and is left with 
+	 * the model of the last fold.
+	 *
+	 * \sa NaiveBayesStatistics, NaiveBayesClassifier::additive() */
 	void xvalidate();
+
+	/** Collect the statistics of the instances of the foldi-th fold 
+	 * for c into stat. */
+	void collect(NaiveBayesStatistics& stat, const Classifier& c, 
+		const size_t foldi) const;
+
+	/** Train and test c on the foldi-th fold.
+	 *
+	 * \param foldStat The statistics of each fold, from collect(), 
+	 *   if merge_folds(); NULL to collect them for this fold.
+	 * \sa xvalidate() */
+	void run_fold(Classifier& c, const size_t foldi, 
+		const vector<NaiveBayesStatistics>* foldStat) const;
 };
 
 #endif